@@ -55,13 +55,47 @@ if "%clang%"=="1" (
 if "%debug%"=="1" set compile=%compile_debug%
 if "%release%"=="1" set compile=%compile_release%
 
+rem Interpreter dispatch (see CHIP8_DISPATCH in chip8.h)
+if "%predecode%"=="1" set compile=%compile% -DCHIP8_DISPATCH=1
+
+if "%profile%"=="1" set compile=%compile% -DCHIP8_PROFILE=1
+
+rem Bounds-checked core (see CHIP8_SAFE in chip8.h)
+if "%safe%"=="1" set compile=%compile% -DCHIP8_SAFE=1
+
+rem Machine variant (see CHIP8_VARIANT in chip8.h)
+if "%schip%"=="1" set compile=%compile% -DCHIP8_VARIANT=1
+if "%xochip%"=="1" set compile=%compile% -DCHIP8_VARIANT=2
+
 rem Build program
 if not exist build mkdir build
 pushd build
 if not exist obj if "%msvc%"=="1" mkdir obj
 %compile% ^
-  ../src/main.c ../src/sdl.c ../src/chip8.c ^
+  ../src/main.c ../src/sdl.c ../src/chip8.c ../src/profile.c ^
+  ../src/rewind.c ../src/queue.c ../src/latency.c ../src/timing.c ^
+  ../src/audio.c ../src/beeper.c ../src/replay.c ../src/quirkdb.c ^
   %compile_link% %out%chip8.exe || exit /b 1
+%compile% ^
+  ../src/headless.c ../src/platform.c ../src/chip8.c ../src/bcache.c ^
+  ../src/jit.c ../src/profile.c ../src/romlib.c ../src/batch.c ^
+  ../src/beeper.c ../src/wav.c ../src/replay.c ../src/quirkdb.c ^
+  %compile_link% %out%chip8-headless.exe || exit /b 1
+rem Core benchmarks; build with `release` for meaningful numbers
+%compile% ^
+  ../src/bench.c ../src/chip8.c ../src/platform.c ^
+  %compile_link% %out%bench.exe || exit /b 1
+%compile% -DCHIP8_SAFE=1 ^
+  ../src/bench.c ../src/chip8.c ../src/platform.c ^
+  %compile_link% %out%bench-safe.exe || exit /b 1
+rem ROM fuzzer
+%compile% ^
+  ../src/fuzz.c ../src/chip8.c ../src/platform.c ^
+  %compile_link% %out%chip8-fuzz.exe || exit /b 1
+rem Static ROM analyser
+%compile% ^
+  ../src/dis.c ../src/chip8.c ../src/platform.c ^
+  %compile_link% %out%chip8-dis.exe || exit /b 1
 popd
 
 popd
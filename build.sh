@@ -49,12 +49,55 @@ fi
 if [ -v debug ]; then compile=$compile_debug; fi
 if [ -v release ]; then compile=$compile_release; fi
 
-# Build program
+# Interpreter dispatch (see CHIP8_DISPATCH in chip8.h)
+if [ -v predecode ]; then compile="$compile -DCHIP8_DISPATCH=1"; fi
+if [ -v goto ]; then compile="$compile -DCHIP8_DISPATCH=2"; fi
+
+if [ -v profile ]; then compile="$compile -DCHIP8_PROFILE=1"; fi
+
+# Bounds-checked core (see CHIP8_SAFE in chip8.h)
+if [ -v safe ]; then compile="$compile -DCHIP8_SAFE=1"; fi
+
+# Machine variant (see CHIP8_VARIANT in chip8.h)
+if [ -v schip ]; then compile="$compile -DCHIP8_VARIANT=1"; fi
+if [ -v xochip ]; then compile="$compile -DCHIP8_VARIANT=2"; fi
+
+# Build programs
 mkdir -p build
 cd build
-$compile ../src/main.c ../src/sdl.c ../src/chip8.c $compile_link $out chip8
+failed=0
+
+sdl_src="../src/main.c ../src/sdl.c ../src/chip8.c ../src/profile.c
+    ../src/rewind.c ../src/queue.c ../src/latency.c ../src/timing.c
+    ../src/audio.c ../src/beeper.c ../src/replay.c ../src/quirkdb.c"
+$compile $sdl_src $compile_link $out chip8 || failed=1
+
+headless_src="../src/headless.c ../src/platform.c ../src/chip8.c ../src/bcache.c
+    ../src/jit.c ../src/profile.c ../src/romlib.c ../src/batch.c
+    ../src/beeper.c ../src/wav.c ../src/replay.c ../src/quirkdb.c"
+$compile $headless_src -lpthread $out chip8-headless || failed=1
+
+# Core benchmarks; build with `release` for meaningful numbers
+$compile ../src/bench.c ../src/chip8.c ../src/platform.c -lm -lpthread \
+    $out bench || failed=1
+$compile -DCHIP8_SAFE=1 ../src/bench.c ../src/chip8.c ../src/platform.c \
+    -lm -lpthread $out bench-safe || failed=1
+
+# ROM fuzzer; `libfuzzer` builds it as a libFuzzer target instead (clang)
+if [ -v libfuzzer ]; then
+    clang -I../src -g -O1 -fsanitize=fuzzer,address -DCHIP8_LIBFUZZER=1 \
+        ../src/fuzz.c ../src/chip8.c ../src/platform.c -lpthread \
+        -o chip8-fuzz || failed=1
+else
+    $compile ../src/fuzz.c ../src/chip8.c ../src/platform.c -lpthread \
+        $out chip8-fuzz || failed=1
+fi
+
+# Static ROM analyser
+$compile ../src/dis.c ../src/chip8.c ../src/platform.c -lpthread \
+    $out chip8-dis || failed=1
 
-if [ $? -ne 0 ]; then
+if [ $failed -ne 0 ]; then
     echo Build failed!
 else
     echo Build succeeded.
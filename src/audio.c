@@ -0,0 +1,89 @@
+#include "audio.h"
+
+static void audio_callback(void *userdata, Uint8 *stream, int len);
+
+int audio_init(struct audio_context *audio, Uint16 samples)
+{
+    /* samples is the device buffer length, which bounds the latency */
+    SDL_AudioSpec want;
+
+    memset(audio, 0, sizeof(*audio));
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        return 1;
+    }
+
+    memset(&want, 0, sizeof(want));
+    want.freq = BEEPER_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = samples;
+    want.callback = audio_callback;
+    want.userdata = audio;
+
+    /* Anything else the device wants, SDL converts to */
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &audio->spec, 0);
+
+    if (audio->device == 0) {
+        return 1;
+    }
+
+    if (beeper_init(&audio->beeper, (uint32_t)audio->spec.freq,
+                    BEEPER_TONE_HZ, BEEPER_AMPLITUDE)) {
+        audio_cleanup(audio);
+        return 1;
+    }
+
+    SDL_PauseAudioDevice(audio->device, 0);
+
+    return 0;
+}
+
+void audio_cleanup(struct audio_context *audio)
+{
+    if (audio->device) {
+        SDL_CloseAudioDevice(audio->device);
+        audio->device = 0;
+    }
+
+    beeper_free(&audio->beeper);
+}
+
+void audio_set_beep(struct audio_context *audio, int on)
+{
+    SDL_AtomicSet(&audio->beep, on);
+}
+
+void audio_report(FILE *f, const struct audio_context *audio)
+{
+    fprintf(f, "audio: %d Hz, %u-sample buffer, %u callbacks, "
+            "%u underruns, longest gap %.1fms\n",
+            audio->spec.freq, audio->spec.samples, audio->callbacks,
+            audio->underruns,
+            audio->max_gap * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+static void audio_callback(void *userdata, Uint8 *stream, int len)
+{
+    struct audio_context *audio = userdata;
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    if (audio->callbacks++ > 0) {
+        Uint64 gap = now - audio->last_callback;
+
+        /* Late by half a buffer or more */
+        if (gap * audio->spec.freq * 2
+            > SDL_GetPerformanceFrequency() * audio->spec.samples * 3) {
+            audio->underruns++;
+        }
+
+        if (gap > audio->max_gap) {
+            audio->max_gap = gap;
+        }
+    }
+
+    audio->last_callback = now;
+
+    beeper_fill(&audio->beeper, (int16_t *)stream,
+                (uint32_t)len / sizeof(int16_t), SDL_AtomicGet(&audio->beep));
+}
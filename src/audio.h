@@ -0,0 +1,37 @@
+#ifndef CHIP8_AUDIO_H
+#define CHIP8_AUDIO_H
+
+#include "beeper.h"
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+
+/* SDL audio output for the beeper. The emulation thread only flips an
+ * atomic flag; the device callback reads it and copies the wavetable, so
+ * neither side ever waits on the other. */
+
+#define AUDIO_DEFAULT_SAMPLES 512
+
+struct audio_context {
+    SDL_AudioDeviceID device;
+    SDL_AudioSpec spec;
+    struct beeper beeper;
+
+    /* Nonzero while the beep should sound */
+    SDL_atomic_t beep;
+
+    /* Callback bookkeeping, only touched by the callback while the device
+     * runs. A callback arriving well over a buffer's length after the
+     * previous one most likely means the device ran dry in between. */
+    Uint64 last_callback;
+    Uint64 max_gap;
+    Uint32 callbacks;
+    Uint32 underruns;
+};
+
+int audio_init(struct audio_context *audio, Uint16 samples);
+void audio_cleanup(struct audio_context *audio);
+void audio_set_beep(struct audio_context *audio, int on);
+void audio_report(FILE *f, const struct audio_context *audio);
+
+#endif
@@ -0,0 +1,491 @@
+#include "batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* One vector of lanes, a byte per machine */
+#if BATCH_LANES == 32
+#include <immintrin.h>
+
+typedef __m256i lanes;
+
+#define LANES_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define LANES_STORE(p, a) _mm256_storeu_si256((__m256i *)(p), a)
+#define LANES_SPLAT(b) _mm256_set1_epi8((char)(b))
+#define LANES_ADD(a, b) _mm256_add_epi8(a, b)
+#define LANES_ADDS(a, b) _mm256_adds_epu8(a, b)
+#define LANES_SUBS(a, b) _mm256_subs_epu8(a, b)
+#define LANES_OR(a, b) _mm256_or_si256(a, b)
+#define LANES_AND(a, b) _mm256_and_si256(a, b)
+#define LANES_XOR(a, b) _mm256_xor_si256(a, b)
+#define LANES_ANDNOT(a, b) _mm256_andnot_si256(a, b)
+#define LANES_CMPEQ(a, b) _mm256_cmpeq_epi8(a, b)
+#elif BATCH_LANES == 16
+#include <emmintrin.h>
+
+typedef __m128i lanes;
+
+#define LANES_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define LANES_STORE(p, a) _mm_storeu_si128((__m128i *)(p), a)
+#define LANES_SPLAT(b) _mm_set1_epi8((char)(b))
+#define LANES_ADD(a, b) _mm_add_epi8(a, b)
+#define LANES_ADDS(a, b) _mm_adds_epu8(a, b)
+#define LANES_SUBS(a, b) _mm_subs_epu8(a, b)
+#define LANES_OR(a, b) _mm_or_si128(a, b)
+#define LANES_AND(a, b) _mm_and_si128(a, b)
+#define LANES_XOR(a, b) _mm_xor_si128(a, b)
+#define LANES_ANDNOT(a, b) _mm_andnot_si128(a, b)
+#define LANES_CMPEQ(a, b) _mm_cmpeq_epi8(a, b)
+#else
+typedef uint8_t lanes;
+
+#define LANES_LOAD(p) (*(p))
+#define LANES_STORE(p, a) (*(p) = (a))
+#define LANES_SPLAT(b) ((uint8_t)(b))
+#define LANES_ADD(a, b) ((uint8_t)((a) + (b)))
+#define LANES_ADDS(a, b) ((uint8_t)((a) + (b) > 0xFF ? 0xFF : (a) + (b)))
+#define LANES_SUBS(a, b) ((uint8_t)((a) > (b) ? (a) - (b) : 0))
+#define LANES_OR(a, b) ((uint8_t)((a) | (b)))
+#define LANES_AND(a, b) ((uint8_t)((a) & (b)))
+#define LANES_XOR(a, b) ((uint8_t)((a) ^ (b)))
+#define LANES_ANDNOT(a, b) ((uint8_t)(~(a) & (b)))
+#define LANES_CMPEQ(a, b) ((uint8_t)((a) == (b) ? 0xFF : 0))
+#endif
+
+/* mem_id of a machine whose memory matches no other */
+#define MEM_PRIVATE 0xFFFFFFFFu
+
+/* new where mask is set, old elsewhere */
+#define LANES_BLEND(mask, new, old) \
+    LANES_OR(LANES_AND(mask, new), LANES_ANDNOT(mask, old))
+
+static uint32_t batch_mem_id(struct chip8_batch *batch, int k);
+static void batch_mem_detach(struct chip8_batch *batch, int k);
+static int batch_group(struct chip8_batch *batch, int lead,
+                       uint16_t opcode);
+static void batch_vector(struct chip8_batch *batch,
+                         const struct chip8_insn *in);
+static void batch_scalar(struct chip8_batch *batch, int k);
+static int batch_vectorizable(uint8_t op, uint8_t quirk_flags);
+
+int batch_init(struct chip8_batch *batch, int count)
+{
+    memset(batch, 0, sizeof(*batch));
+
+    batch->count = count;
+    batch->stride = (count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+
+    batch->v = calloc((size_t)batch->stride * 16, 1);
+    batch->pc = calloc(batch->stride, sizeof(*batch->pc));
+    batch->i = calloc(batch->stride, sizeof(*batch->i));
+    batch->opcode = calloc(batch->stride, sizeof(*batch->opcode));
+    batch->delay_timer = calloc(batch->stride, 1);
+    batch->sound_timer = calloc(batch->stride, 1);
+    batch->mem_id = calloc(batch->stride, sizeof(*batch->mem_id));
+    batch->ctxs = calloc(count, sizeof(*batch->ctxs));
+    batch->mask = calloc(batch->stride, 1);
+    batch->taken = calloc(batch->stride, 1);
+    batch->done = calloc(batch->stride, 1);
+
+    if (!batch->v || !batch->pc || !batch->i || !batch->opcode
+        || !batch->delay_timer || !batch->sound_timer || !batch->mem_id
+        || !batch->ctxs || !batch->mask || !batch->taken || !batch->done) {
+        batch_free(batch);
+        return 1;
+    }
+
+    for (int k = 0; k < count; ++k) {
+        batch->mem_id[k] = MEM_PRIVATE;
+    }
+
+    for (int k = 0; k < count; ++k) {
+        chip8_init(&batch->ctxs[k]);
+        batch_load(batch, k, &batch->ctxs[k]);
+    }
+
+    return 0;
+}
+
+void batch_free(struct chip8_batch *batch)
+{
+    free(batch->v);
+    free(batch->pc);
+    free(batch->i);
+    free(batch->opcode);
+    free(batch->delay_timer);
+    free(batch->sound_timer);
+    free(batch->mem_id);
+    free(batch->ctxs);
+    free(batch->mask);
+    free(batch->taken);
+    free(batch->done);
+    memset(batch, 0, sizeof(*batch));
+}
+
+void batch_load(struct chip8_batch *batch, int k,
+                const struct chip8_context *ctx)
+{
+    /* Copy ctx into machine k */
+    batch_mem_detach(batch, k);
+
+    if (ctx != &batch->ctxs[k]) {
+        chip8_clone(&batch->ctxs[k], ctx);
+    }
+
+    for (int r = 0; r < 16; ++r) {
+        batch->v[r * batch->stride + k] = ctx->registers[r];
+    }
+
+    batch->pc[k] = ctx->pc;
+    batch->i[k] = ctx->i;
+    batch->opcode[k] = ctx->opcode;
+    batch->delay_timer[k] = ctx->delay_timer;
+    batch->sound_timer[k] = ctx->sound_timer;
+    batch->mem_id[k] = batch_mem_id(batch, k);
+    batch->quirk_flags |= chip8_quirk_flags(ctx->quirks);
+}
+
+void batch_store(struct chip8_batch *batch, int k, struct chip8_context *ctx)
+{
+    /* Copy machine k out to ctx */
+    struct chip8_context *src = &batch->ctxs[k];
+
+    for (int r = 0; r < 16; ++r) {
+        src->registers[r] = batch->v[r * batch->stride + k];
+    }
+
+    src->pc = batch->pc[k];
+    src->i = batch->i[k];
+    src->opcode = batch->opcode[k];
+    src->delay_timer = batch->delay_timer[k];
+    src->sound_timer = batch->sound_timer[k];
+
+    if (ctx != src) {
+        chip8_clone(ctx, src);
+    }
+}
+
+void batch_step(struct chip8_batch *batch)
+{
+    int tries = 0;
+
+    /* Lanes past count are always done */
+    memset(batch->done, 0, batch->count);
+    memset(batch->done + batch->count, 0xFF, batch->stride - batch->count);
+
+    for (int lead = 0; lead < batch->count; ++lead) {
+        const uint8_t *mem = batch->ctxs[lead].mem;
+        uint16_t pc = batch->pc[lead];
+        struct chip8_insn in;
+
+        if (batch->done[lead]) {
+            continue;
+        }
+
+        if (tries < BATCH_MAX_GROUPS && pc < PROGRAM_END) {
+            chip8_decode((mem[pc] << 8u) | mem[pc + 1], &in);
+
+            if (batch_vectorizable(in.op, batch->quirk_flags)) {
+                tries++;
+
+                if (batch_group(batch, lead, in.opcode) >= BATCH_MIN_GROUP) {
+                    batch_vector(batch, &in);
+                    continue;
+                }
+            }
+        }
+
+        batch_scalar(batch, lead);
+        batch->done[lead] = 0xFF;
+    }
+}
+
+void batch_run(struct chip8_batch *batch, uint32_t cycles)
+{
+    for (uint32_t c = 0; c < cycles; ++c) {
+        batch_step(batch);
+    }
+}
+
+void batch_tick_timers(struct chip8_batch *batch)
+{
+    /* chip8_tick_timers for every machine: both count down to 0 */
+    lanes one = LANES_SPLAT(1);
+
+    for (int k = 0; k < batch->stride; k += BATCH_LANES) {
+        uint8_t *delay = batch->delay_timer + k;
+        uint8_t *sound = batch->sound_timer + k;
+
+        LANES_STORE(delay, LANES_SUBS(LANES_LOAD(delay), one));
+        LANES_STORE(sound, LANES_SUBS(LANES_LOAD(sound), one));
+    }
+}
+
+static uint32_t batch_mem_id(struct chip8_batch *batch, int k)
+{
+    /* Join the group of another machine with the same memory, else start
+     * one. A group's id is the index of one of its members. */
+    const uint8_t *mem = batch->ctxs[k].mem;
+
+    for (int other = 0; other < batch->count; ++other) {
+        if (other != k && batch->mem_id[other] == (uint32_t)other
+            && memcmp(batch->ctxs[other].mem, mem, RAM_SIZE) == 0) {
+            return (uint32_t)other;
+        }
+    }
+
+    return (uint32_t)k;
+}
+
+static void batch_mem_detach(struct chip8_batch *batch, int k)
+{
+    /* k's memory has changed (or is about to). If the group was named
+     * after k, the rest of it takes another member's index. */
+    uint32_t id = batch->mem_id[k];
+    int next = -1;
+
+    batch->mem_id[k] = MEM_PRIVATE;
+
+    if (id != (uint32_t)k) {
+        return;
+    }
+
+    for (int other = 0; other < batch->count; ++other) {
+        if (batch->mem_id[other] == id) {
+            if (next < 0) {
+                next = other;
+            }
+
+            batch->mem_id[other] = (uint32_t)next;
+        }
+    }
+}
+
+static int batch_group(struct chip8_batch *batch, int lead, uint16_t opcode)
+{
+    /* Mask every machine not yet stepped that is at lead's pc with the
+     * same opcode in its own memory. Returns the group size. */
+    uint16_t pc = batch->pc[lead];
+    uint32_t mem_id = batch->mem_id[lead];
+    uint8_t shared = mem_id != MEM_PRIVATE ? 0xFF : 0;
+    uint8_t unsure = 0;
+    int size = 0;
+
+    /* Branch-free over the arrays; only machines whose memory may differ
+     * from lead's need their opcode read */
+    for (int k = 0; k < batch->stride; ++k) {
+        uint8_t at_pc = batch->pc[k] == pc ? 0xFF : 0;
+        uint8_t same = batch->mem_id[k] == mem_id ? shared : 0;
+        uint8_t pending = (uint8_t)~batch->done[k];
+
+        batch->mask[k] = at_pc & same & pending;
+        unsure |= at_pc & (uint8_t)~same & pending;
+    }
+
+    for (int k = lead; unsure && k < batch->count; ++k) {
+        const uint8_t *mem = batch->ctxs[k].mem;
+
+        if (!batch->done[k] && !batch->mask[k] && batch->pc[k] == pc
+            && mem[pc] == (uint8_t)(opcode >> 8)
+            && mem[pc + 1] == (uint8_t)opcode) {
+            batch->mask[k] = 0xFF;
+        }
+    }
+
+    for (int k = 0; k < batch->stride; ++k) {
+        size += batch->mask[k] & 1;
+    }
+
+    return size;
+}
+
+static void batch_vector(struct chip8_batch *batch,
+                         const struct chip8_insn *in)
+{
+    /* Run one instruction for every machine in the mask. Register operands
+     * are the same for the whole group, so each is one row of lanes. */
+    uint8_t *vx = &batch->v[in->x * batch->stride];
+    uint8_t *vy = &batch->v[in->y * batch->stride];
+    uint8_t *vf = &batch->v[0xF * batch->stride];
+    lanes kk = LANES_SPLAT(in->kk);
+    lanes one = LANES_SPLAT(1);
+
+    for (int k = 0; k < batch->stride; k += BATCH_LANES) {
+        lanes mask = LANES_LOAD(batch->mask + k);
+        lanes x = LANES_LOAD(vx + k);
+        lanes y = LANES_LOAD(vy + k);
+        lanes result = x;
+
+        switch (in->op) {
+        case CHIP8_OP_6xkk:
+            result = kk;
+            break;
+
+        case CHIP8_OP_7xkk:
+            result = LANES_ADD(x, kk);
+            break;
+
+        case CHIP8_OP_8xy0:
+            result = y;
+            break;
+
+        case CHIP8_OP_8xy1:
+            result = LANES_OR(x, y);
+            break;
+
+        case CHIP8_OP_8xy2:
+            result = LANES_AND(x, y);
+            break;
+
+        case CHIP8_OP_8xy3:
+            result = LANES_XOR(x, y);
+            break;
+
+        case CHIP8_OP_8xy4:
+            /* Carry where the saturating sum differs from the wrapped one.
+             * VF is written first, as op_8xy4 does. */
+            result = LANES_ADD(x, y);
+            LANES_STORE(vf + k,
+                        LANES_BLEND(mask,
+                                    LANES_ANDNOT(LANES_CMPEQ(LANES_ADDS(x, y),
+                                                             result), one),
+                                    LANES_LOAD(vf + k)));
+            break;
+
+        case CHIP8_OP_3xkk:
+            LANES_STORE(batch->taken + k, LANES_CMPEQ(x, kk));
+            break;
+
+        case CHIP8_OP_4xkk:
+            LANES_STORE(batch->taken + k, LANES_ANDNOT(LANES_CMPEQ(x, kk),
+                                                       LANES_SPLAT(0xFF)));
+            break;
+
+        case CHIP8_OP_5xy0:
+            LANES_STORE(batch->taken + k, LANES_CMPEQ(x, y));
+            break;
+
+        case CHIP8_OP_9xy0:
+            LANES_STORE(batch->taken + k, LANES_ANDNOT(LANES_CMPEQ(x, y),
+                                                       LANES_SPLAT(0xFF)));
+            break;
+
+        default:
+            break;
+        }
+
+        LANES_STORE(vx + k, LANES_BLEND(mask, result, x));
+    }
+
+    /* pc, I and the opcode per machine */
+    switch (in->op) {
+    case CHIP8_OP_1nnn:
+        for (int k = 0; k < batch->stride; ++k) {
+            batch->pc[k] = batch->mask[k] ? in->nnn : batch->pc[k];
+        }
+        break;
+
+    case CHIP8_OP_3xkk:
+    case CHIP8_OP_4xkk:
+    case CHIP8_OP_5xy0:
+    case CHIP8_OP_9xy0:
+#if CHIP8_VARIANT == CHIP8_VARIANT_XOCHIP
+        /* Whether F000 nnnn follows is up to each machine's memory */
+        for (int k = 0; k < batch->count; ++k) {
+            uint8_t skip = CHIP8_SKIP_SIZE(batch->ctxs[k].mem,
+                                           (uint16_t)(batch->pc[k] + 2));
+
+            batch->pc[k] += batch->mask[k] & (2 + (batch->taken[k] & skip));
+        }
+#else
+        for (int k = 0; k < batch->stride; ++k) {
+            batch->pc[k] += batch->mask[k] & (2 + (batch->taken[k] & 2));
+        }
+#endif
+        break;
+
+    case CHIP8_OP_Annn:
+        for (int k = 0; k < batch->stride; ++k) {
+            batch->i[k] = batch->mask[k] ? in->nnn : batch->i[k];
+        }
+
+        /* Fall through */
+    default:
+        for (int k = 0; k < batch->stride; ++k) {
+            batch->pc[k] += batch->mask[k] & 2;
+        }
+        break;
+    }
+
+    for (int k = 0; k < batch->stride; ++k) {
+        batch->opcode[k] = batch->mask[k] ? in->opcode : batch->opcode[k];
+        batch->done[k] |= batch->mask[k];
+    }
+
+    batch->vector_steps++;
+}
+
+static void batch_scalar(struct chip8_batch *batch, int k)
+{
+    /* One chip8_cycle with the machine's SoA state moved in and out */
+    struct chip8_context *ctx = &batch->ctxs[k];
+
+    for (int r = 0; r < 16; ++r) {
+        ctx->registers[r] = batch->v[r * batch->stride + k];
+    }
+
+    ctx->pc = batch->pc[k];
+    ctx->i = batch->i[k];
+    ctx->opcode = batch->opcode[k];
+    ctx->delay_timer = batch->delay_timer[k];
+    ctx->sound_timer = batch->sound_timer[k];
+
+    chip8_cycle(ctx);
+
+    for (int r = 0; r < 16; ++r) {
+        batch->v[r * batch->stride + k] = ctx->registers[r];
+    }
+
+    batch->pc[k] = ctx->pc;
+    batch->i[k] = ctx->i;
+    batch->opcode[k] = ctx->opcode;
+    batch->delay_timer[k] = ctx->delay_timer;
+    batch->sound_timer[k] = ctx->sound_timer;
+
+    if (batch->mem_id[k] != MEM_PRIVATE) {
+        struct chip8_insn in;
+
+        chip8_decode(ctx->opcode, &in);
+
+        if (chip8_op_flags(in.op) & CHIP8_OPF_WRITE) {
+            batch_mem_detach(batch, k);
+        }
+    }
+
+    batch->scalar_steps++;
+}
+
+static int batch_vectorizable(uint8_t op, uint8_t quirk_flags)
+{
+    switch (op) {
+    case CHIP8_OP_8xy1:
+    case CHIP8_OP_8xy2:
+    case CHIP8_OP_8xy3:
+        return !(quirk_flags & CHIP8_QUIRK_VF_RESET);
+
+    case CHIP8_OP_1nnn:
+    case CHIP8_OP_3xkk:
+    case CHIP8_OP_4xkk:
+    case CHIP8_OP_5xy0:
+    case CHIP8_OP_6xkk:
+    case CHIP8_OP_7xkk:
+    case CHIP8_OP_8xy0:
+    case CHIP8_OP_8xy4:
+    case CHIP8_OP_9xy0:
+    case CHIP8_OP_Annn:
+        return 1;
+
+    default:
+        return 0;
+    }
+}
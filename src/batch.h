@@ -0,0 +1,74 @@
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+
+#include "chip8.h"
+
+/* Batched engine: N machines stepped in lockstep, one instruction each per
+ * step. V0-VF, pc, I and the timers are held as structure-of-arrays
+ * (register r of every machine side by side); everything else stays in a
+ * chip8_context per machine. Machines at the same pc with the same opcode
+ * run simple ALU, load and skip instructions as one SIMD operation over the
+ * whole group; the rest step through chip8_cycle, so results match running
+ * each machine on its own. */
+
+#if defined(__AVX2__)
+#define BATCH_LANES 32
+#elif defined(__SSE2__) || defined(_M_X64)
+#define BATCH_LANES 16
+#else
+#define BATCH_LANES 1
+#endif
+
+/* Groups tried per step before everything left goes scalar, which bounds
+ * the cost of a step when the machines have all diverged */
+#define BATCH_MAX_GROUPS 4
+
+/* Smaller groups aren't worth a pass over every lane */
+#define BATCH_MIN_GROUP 4
+
+struct chip8_batch {
+    int count;
+
+    /* count rounded up to BATCH_LANES; lanes past count are never used */
+    int stride;
+
+    /* Register r of machine k at v[r * stride + k] */
+    uint8_t *v;
+    uint16_t *pc;
+    uint16_t *i;
+    uint16_t *opcode;
+    uint8_t *delay_timer;
+    uint8_t *sound_timer;
+
+    /* Machines with the same id have identical memory, so grouping can
+     * skip comparing their opcodes. A machine gets an id of its own once
+     * it writes to memory. */
+    uint32_t *mem_id;
+
+    /* Memory, display, stack and keys; their registers, pc, I, opcode and
+     * timers are stale while batched. Change mem only through batch_load. */
+    struct chip8_context *ctxs;
+
+    /* CHIP8_QUIRK_* bits of every machine loaded; instructions they change
+     * always run scalar */
+    uint8_t quirk_flags;
+
+    /* Per-step scratch, one byte per lane, 0xFF for set */
+    uint8_t *mask;
+    uint8_t *taken;
+    uint8_t *done;
+
+    uint64_t vector_steps;
+    uint64_t scalar_steps;
+};
+
+int batch_init(struct chip8_batch *batch, int count);
+void batch_free(struct chip8_batch *batch);
+void batch_load(struct chip8_batch *batch, int k,
+                const struct chip8_context *ctx);
+void batch_store(struct chip8_batch *batch, int k, struct chip8_context *ctx);
+void batch_step(struct chip8_batch *batch);
+void batch_run(struct chip8_batch *batch, uint32_t cycles);
+void batch_tick_timers(struct chip8_batch *batch);
+
+#endif
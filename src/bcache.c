@@ -0,0 +1,111 @@
+#include "bcache.h"
+
+#include <string.h>
+
+/* Fx55 and Fx33 write at most this many bytes from I */
+#define WRITE_SPAN 16
+
+static const struct bcache_block *bcache_build(struct bcache_context *cache,
+                                               struct chip8_context *ctx);
+
+void bcache_init(struct bcache_context *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+}
+
+void bcache_flush(struct bcache_context *cache)
+{
+    memset(cache->index, 0, sizeof(cache->index));
+    cache->used = 0;
+}
+
+void bcache_invalidate(struct bcache_context *cache, uint32_t addr,
+                       uint32_t len)
+{
+    /* Any block overlapping [addr, addr + len) starts no earlier than
+     * the longest block before addr */
+    uint32_t first = addr > BCACHE_BLOCK_INSNS * 2
+                     ? addr - BCACHE_BLOCK_INSNS * 2 : 0;
+    uint32_t end = addr + len < RAM_SIZE ? addr + len : RAM_SIZE;
+
+    for (uint32_t start = first; start < end; ++start) {
+        uint16_t slot = cache->index[start];
+
+        if (slot
+            && start + cache->blocks[slot - 1].count * 2u > addr) {
+            cache->index[start] = 0;
+            cache->invalidations++;
+        }
+    }
+}
+
+const struct bcache_block *bcache_lookup(struct bcache_context *cache,
+                                         struct chip8_context *ctx)
+{
+    uint16_t slot = cache->index[ctx->pc];
+
+    if (slot) {
+        cache->hits++;
+        return &cache->blocks[slot - 1];
+    }
+
+    cache->misses++;
+
+    return bcache_build(cache, ctx);
+}
+
+void bcache_run(struct bcache_context *cache, struct chip8_context *ctx,
+                uint32_t cycles)
+{
+    while (cycles > 0 && ctx->pc < PROGRAM_END) {
+        const struct bcache_block *block = bcache_lookup(cache, ctx);
+        uint32_t count = block->count < cycles ? block->count : cycles;
+        const struct chip8_insn *last = &block->insns[count - 1];
+
+        for (uint32_t k = 0; k < count; ++k) {
+            chip8_exec(ctx, &block->insns[k]);
+        }
+
+        cycles -= count;
+
+        if (chip8_op_flags(last->op) & CHIP8_OPF_WRITE) {
+            /* With the load/store quirk I has already moved past what was
+             * written */
+            uint32_t back = chip8_quirk_flags(ctx->quirks)
+                            & CHIP8_QUIRK_LOAD_STORE_I ? WRITE_SPAN : 0;
+
+            bcache_invalidate(cache, ctx->i > back ? ctx->i - back : 0,
+                              WRITE_SPAN + back);
+        }
+    }
+}
+
+static const struct bcache_block *bcache_build(struct bcache_context *cache,
+                                               struct chip8_context *ctx)
+{
+    struct bcache_block *block;
+    uint32_t addr = ctx->pc;
+
+    if (cache->used == BCACHE_BLOCKS) {
+        bcache_flush(cache);
+    }
+
+    block = &cache->blocks[cache->used++];
+    block->start = ctx->pc;
+    block->count = 0;
+
+    while (block->count < BCACHE_BLOCK_INSNS && addr < PROGRAM_END) {
+        struct chip8_insn *insn = &block->insns[block->count++];
+
+        chip8_decode((ctx->mem[addr] << 8u) | ctx->mem[addr + 1], insn);
+        addr += 2;
+
+        if (chip8_op_flags(insn->op) & (CHIP8_OPF_BRANCH | CHIP8_OPF_WRITE)) {
+            break;
+        }
+    }
+
+    cache->index[block->start] = cache->used;
+
+    return block;
+}
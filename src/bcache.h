@@ -0,0 +1,40 @@
+#ifndef CHIP8_BCACHE_H
+#define CHIP8_BCACHE_H
+
+#include "chip8.h"
+
+/* Basic-block cache: straight-line runs of instructions are decoded once
+ * and then executed a block per lookup. A block ends after any branch or
+ * memory write, so self-modifying code is caught before the next lookup. */
+
+#define BCACHE_BLOCK_INSNS 32
+#define BCACHE_BLOCKS 512
+
+struct bcache_block {
+    uint16_t start;
+    uint16_t count;
+    struct chip8_insn insns[BCACHE_BLOCK_INSNS];
+};
+
+struct bcache_context {
+    /* Block slot + 1 for each block start address, 0 if none */
+    uint16_t index[RAM_SIZE];
+    uint16_t used;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+
+    struct bcache_block blocks[BCACHE_BLOCKS];
+};
+
+void bcache_init(struct bcache_context *cache);
+void bcache_flush(struct bcache_context *cache);
+void bcache_invalidate(struct bcache_context *cache, uint32_t addr,
+                       uint32_t len);
+const struct bcache_block *bcache_lookup(struct bcache_context *cache,
+                                         struct chip8_context *ctx);
+void bcache_run(struct bcache_context *cache, struct chip8_context *ctx,
+                uint32_t cycles);
+
+#endif
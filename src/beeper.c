@@ -0,0 +1,68 @@
+#include "beeper.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int beeper_init(struct beeper *beeper, uint32_t rate, uint32_t tone_hz,
+                int16_t amplitude)
+{
+    uint32_t a = rate;
+    uint32_t b = tone_hz;
+
+    memset(beeper, 0, sizeof(*beeper));
+
+    if (rate == 0 || tone_hz == 0 || tone_hz * 2 > rate) {
+        return 1;
+    }
+
+    /* rate / gcd(rate, tone) samples is exactly tone / gcd periods */
+    while (b != 0) {
+        uint32_t t = a % b;
+
+        a = b;
+        b = t;
+    }
+
+    beeper->length = rate / a;
+
+    if ((beeper->table = malloc(beeper->length * sizeof(int16_t))) == NULL) {
+        return 1;
+    }
+
+    /* Sample n is in half-period (n * tone * 2 / rate) */
+    for (uint32_t n = 0; n < beeper->length; ++n) {
+        uint64_t half = (uint64_t)n * tone_hz * 2 / rate;
+
+        beeper->table[n] = half & 1 ? -amplitude : amplitude;
+    }
+
+    return 0;
+}
+
+void beeper_free(struct beeper *beeper)
+{
+    free(beeper->table);
+    beeper->table = NULL;
+}
+
+void beeper_fill(struct beeper *beeper, int16_t *out, uint32_t count,
+                 int on)
+{
+    if (!on) {
+        memset(out, 0, count * sizeof(int16_t));
+        return;
+    }
+
+    while (count > 0) {
+        uint32_t run = beeper->length - beeper->phase;
+
+        if (run > count) {
+            run = count;
+        }
+
+        memcpy(out, beeper->table + beeper->phase, run * sizeof(int16_t));
+        out += run;
+        count -= run;
+        beeper->phase = (beeper->phase + run) % beeper->length;
+    }
+}
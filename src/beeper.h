@@ -0,0 +1,29 @@
+#ifndef CHIP8_BEEPER_H
+#define CHIP8_BEEPER_H
+
+#include <stdint.h>
+
+/* The CHIP-8 beep as a pre-generated square wave. The table holds a whole
+ * number of periods so it loops seamlessly, and filling a buffer is only
+ * copying from it: no per-sample work and no allocation after init, which
+ * keeps it safe for an audio callback. */
+
+#define BEEPER_RATE 48000
+#define BEEPER_TONE_HZ 440
+#define BEEPER_AMPLITUDE 3000
+
+struct beeper {
+    int16_t *table;
+    uint32_t length;
+
+    /* Next table sample to play */
+    uint32_t phase;
+};
+
+int beeper_init(struct beeper *beeper, uint32_t rate, uint32_t tone_hz,
+                int16_t amplitude);
+void beeper_free(struct beeper *beeper);
+void beeper_fill(struct beeper *beeper, int16_t *out, uint32_t count,
+                 int on);
+
+#endif
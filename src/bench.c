@@ -0,0 +1,246 @@
+#include "chip8.h"
+#include "platform.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Core micro-benchmarks: each workload is a small synthetic ROM stuck in a
+ * loop, run for a fixed number of instructions several times over. Only
+ * chip8.c is linked (plus platform.c for the clock), so the numbers track
+ * the interpreter alone. The build makes bench and bench-safe, the same
+ * suite over the unchecked and CHIP8_SAFE cores; SCHIP and XO-CHIP builds
+ * add a hires scrolling workload. */
+
+#define DEFAULT_CYCLES 20000000
+#define DEFAULT_RUNS 5
+
+struct bench_workload {
+    const char *name;
+    const char *description;
+    const uint8_t *rom;
+    size_t size;
+};
+
+static const uint8_t rom_alu[] = {
+    0x60, 0x01, /* 200: LD V0, #01 */
+    0x61, 0x03, /* 202: LD V1, #03 */
+    0x80, 0x14, /* 204: ADD V0, V1 */
+    0x81, 0x21, /* 206: OR V1, V2 */
+    0x82, 0x32, /* 208: AND V2, V3 */
+    0x83, 0x03, /* 20A: XOR V3, V0 */
+    0x84, 0x15, /* 20C: SUB V4, V1 */
+    0x85, 0x26, /* 20E: SHR V5, V2 */
+    0x86, 0x37, /* 210: SUBN V6, V3 */
+    0x87, 0x4E, /* 212: SHL V7, V4 */
+    0x88, 0x50, /* 214: LD V8, V5 */
+    0x80, 0x64, /* 216: ADD V0, V6 */
+    0x12, 0x04  /* 218: JP 204 */
+};
+
+static const uint8_t rom_drw[] = {
+    0xA2, 0x10, /* 200: LD I, 210 */
+    0xD0, 0x1F, /* 202: DRW V0, V1, 15 */
+    0x70, 0x03, /* 204: ADD V0, #03 */
+    0x71, 0x05, /* 206: ADD V1, #05 */
+    0xD2, 0x38, /* 208: DRW V2, V3, 8 */
+    0x72, 0x07, /* 20A: ADD V2, #07 */
+    0x12, 0x02, /* 20C: JP 202 */
+    0x00, 0x00,
+    0x3C, 0x7E, 0xFF, 0xDB, 0xFF, 0x7E, 0x3C, 0x18, /* 210: sprite */
+    0x3C, 0x66, 0xC3, 0x81, 0xC3, 0x66, 0x3C
+};
+
+static const uint8_t rom_call[] = {
+    0x22, 0x06, /* 200: CALL 206 */
+    0x12, 0x00, /* 202: JP 200 */
+    0x00, 0x00,
+    0x70, 0x01, /* 206: ADD V0, #01 */
+    0x30, 0x0E, /* 208: SE V0, #0E (14 levels deep) */
+    0x22, 0x06, /* 20A: CALL 206 */
+    0x70, 0xFF, /* 20C: ADD V0, #FF */
+    0x00, 0xEE  /* 20E: RET */
+};
+
+static const uint8_t rom_mem[] = {
+    0xA3, 0x00, /* 200: LD I, 300 */
+    0x6C, 0x10, /* 202: LD VC, #10 */
+    0x6D, 0x00, /* 204: LD VD, #00 */
+    0xFF, 0x55, /* 206: LD [I], VF */
+    0xFF, 0x65, /* 208: LD VF, [I] */
+    0xFC, 0x1E, /* 20A: ADD I, VC */
+    0x7D, 0x01, /* 20C: ADD VD, #01 */
+    0x3D, 0x40, /* 20E: SE VD, #40 (sweep 300-6FF) */
+    0x12, 0x06, /* 210: JP 206 */
+    0x12, 0x00  /* 212: JP 200 */
+};
+
+static const uint8_t rom_rnd[] = {
+    0xC0, 0xFF, /* 200: RND V0, #FF */
+    0xC1, 0x0F, /* 202: RND V1, #0F */
+    0xC2, 0xF0, /* 204: RND V2, #F0 */
+    0xC3, 0xAA, /* 206: RND V3, #AA */
+    0x80, 0x14, /* 208: ADD V0, V1 */
+    0x12, 0x00  /* 20A: JP 200 */
+};
+
+#if CHIP8_VARIANT != CHIP8_VARIANT_CHIP8
+static const uint8_t rom_scroll[] = {
+    0x00, 0xFF, /* 200: HIGH */
+    0xA2, 0x14, /* 202: LD I, 214 */
+    0xD0, 0x10, /* 204: DRW V0, V1, 0 (16x16) */
+    0x00, 0xC3, /* 206: SCD 3 */
+    0x00, 0xFB, /* 208: SCR */
+    0x70, 0x1D, /* 20A: ADD V0, #1D */
+    0x00, 0xFC, /* 20C: SCL */
+    0x71, 0x0B, /* 20E: ADD V1, #0B */
+    0x12, 0x04, /* 210: JP 204 */
+    0x00, 0x00,
+    0xFF, 0xFF, 0x80, 0x01, 0xBF, 0xFD, 0xA0, 0x05, /* 214: 16x16 sprite */
+    0xAF, 0xF5, 0xA8, 0x15, 0xAB, 0xD5, 0xAA, 0x55,
+    0xAA, 0x55, 0xAB, 0xD5, 0xA8, 0x15, 0xAF, 0xF5,
+    0xA0, 0x05, 0xBF, 0xFD, 0x80, 0x01, 0xFF, 0xFF
+};
+#endif
+
+static const struct bench_workload workloads[] = {
+    { "alu", "8xy* register arithmetic", rom_alu, sizeof(rom_alu) },
+    { "drw", "sprite storm, wrapping DRW", rom_drw, sizeof(rom_drw) },
+    { "call", "CALL/RET recursion", rom_call, sizeof(rom_call) },
+    { "mem", "Fx55/Fx65 memory sweep", rom_mem, sizeof(rom_mem) },
+    { "rnd", "RND-heavy loop", rom_rnd, sizeof(rom_rnd) },
+#if CHIP8_VARIANT != CHIP8_VARIANT_CHIP8
+    { "scroll", "hires 16x16 DRW and scrolls", rom_scroll, sizeof(rom_scroll) }
+#endif
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+static double bench_run(struct chip8_context *ctx,
+                        const struct bench_workload *workload,
+                        uint32_t cycles);
+
+static void usage(void)
+{
+    printf("Usage: bench [options] [workload]...\n"
+           "  -c <cycles>  Instructions per run (default %d)\n"
+           "  -r <runs>    Timed runs per workload (default %d)\n"
+           "Workloads:\n",
+           DEFAULT_CYCLES, DEFAULT_RUNS);
+
+    for (size_t w = 0; w < WORKLOAD_COUNT; ++w) {
+        printf("  %-12s %s\n", workloads[w].name, workloads[w].description);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct chip8_context *ctx = malloc(sizeof(*ctx));
+    uint32_t cycles = DEFAULT_CYCLES;
+    int runs = DEFAULT_RUNS;
+    int selected[WORKLOAD_COUNT];
+    int any_selected = 0;
+
+    memset(selected, 0, sizeof(selected));
+
+    for (int arg = 1; arg < argc; ++arg) {
+        const char *opt = argv[arg];
+
+        if (strcmp(opt, "-c") == 0 && arg + 1 < argc) {
+            cycles = (uint32_t)strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(opt, "-r") == 0 && arg + 1 < argc) {
+            runs = atoi(argv[++arg]);
+        } else {
+            size_t w = 0;
+
+            while (w < WORKLOAD_COUNT && strcmp(opt, workloads[w].name) != 0) {
+                ++w;
+            }
+
+            if (w == WORKLOAD_COUNT) {
+                usage();
+                free(ctx);
+                return 1;
+            }
+
+            selected[w] = 1;
+            any_selected = 1;
+        }
+    }
+
+    if (!ctx || cycles == 0 || runs < 1) {
+        usage();
+        free(ctx);
+        return 1;
+    }
+
+    printf("%u instructions x %d runs per workload, %s %s core\n", cycles,
+           runs, CHIP8_SAFE ? "checked" : "unchecked", CHIP8_VARIANT_NAME);
+    printf("%-8s %10s %10s %10s %14s\n",
+           "workload", "ns/insn", "min", "stddev", "IPS");
+
+    for (size_t w = 0; w < WORKLOAD_COUNT; ++w) {
+        double sum = 0.0;
+        double sum_sq = 0.0;
+        double best = 0.0;
+        double mean;
+        double variance;
+
+        if (any_selected && !selected[w]) {
+            continue;
+        }
+
+        /* Untimed warm-up so the first run doesn't pay for cold caches or
+         * the lazy decode table */
+        bench_run(ctx, &workloads[w], cycles);
+
+        for (int r = 0; r < runs; ++r) {
+            double ns = bench_run(ctx, &workloads[w], cycles) / cycles;
+
+            sum += ns;
+            sum_sq += ns * ns;
+
+            if (r == 0 || ns < best) {
+                best = ns;
+            }
+        }
+
+        mean = sum / runs;
+        variance = runs > 1 ? (sum_sq - sum * mean) / (runs - 1) : 0.0;
+
+        printf("%-8s %10.3f %10.3f %9.1f%% %14.0f\n",
+               workloads[w].name, mean, best,
+               mean > 0.0 ? 100.0 * sqrt(variance > 0.0 ? variance : 0.0)
+                            / mean : 0.0,
+               mean > 0.0 ? 1e9 / mean : 0.0);
+    }
+
+    free(ctx);
+
+    return 0;
+}
+
+static double bench_run(struct chip8_context *ctx,
+                        const struct bench_workload *workload,
+                        uint32_t cycles)
+{
+    uint64_t start;
+    uint64_t elapsed;
+    int fault;
+
+    chip8_init(ctx);
+    memcpy(&ctx->mem[PROGRAM_START], workload->rom, workload->size);
+
+    start = platform_time_ns();
+    fault = chip8_run(ctx, cycles);
+    elapsed = platform_time_ns() - start;
+
+    /* A stopped run did less work than timed for */
+    if (fault != CHIP8_FAULT_NONE) {
+        printf("%s stopped early on %s\n", workload->name,
+               chip8_fault_string(fault));
+    }
+
+    return (double)elapsed;
+}
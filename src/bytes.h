@@ -0,0 +1,47 @@
+#ifndef CHIP8_BYTES_H
+#define CHIP8_BYTES_H
+
+#include <stdint.h>
+
+/* Little-endian encoding shared by the save state, replay and WAV formats.
+ * The put functions return the byte after the value written. */
+
+static inline uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+
+    return p + 2;
+}
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    return put_u16(put_u16(p, (uint16_t)value), (uint16_t)(value >> 16));
+}
+
+static inline uint8_t *put_u64(uint8_t *p, uint64_t value)
+{
+    for (int b = 0; b < 8; ++b) {
+        p[b] = (uint8_t)(value >> (b * 8));
+    }
+
+    return p + 8;
+}
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t value = 0;
+
+    for (int b = 7; b >= 0; --b) {
+        value = (value << 8) | p[b];
+    }
+
+    return value;
+}
+
+#endif
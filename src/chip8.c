@@ -1,67 +1,192 @@
 #include "chip8.h"
+#include "bytes.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 /* http://devernay.free.fr/hacks/chip8/C8TECH10.HTM */
 /* Mostly used this as a reference */
 
-#define RESERVED_START 0x000
-#define RESERVED_END 0x1FF
-#define PROGRAM_START 0x200
-#define PROGRAM_END 0xFFF
-
-static void op_invalid(struct chip8_context *ctx);
-
-static void op_0_decode(struct chip8_context *ctx);
-static void op_0nnn(struct chip8_context *ctx); /* SYS addr */
-static void op_00E0(struct chip8_context *ctx); /* CLS */
-static void op_00EE(struct chip8_context *ctx); /* RET */
-
-static void op_1nnn(struct chip8_context *ctx); /* JP addr */
-static void op_2nnn(struct chip8_context *ctx); /* CALL addr */
-static void op_3xkk(struct chip8_context *ctx); /* SE Vx, byte */
-static void op_4xkk(struct chip8_context *ctx); /* SNE Vx, byte */
-static void op_5xy0(struct chip8_context *ctx); /* SE Vx, Vy */
-static void op_6xkk(struct chip8_context *ctx); /* LD Vx, byte */
-static void op_7xkk(struct chip8_context *ctx); /* ADD Vx, byte */
-
-static void op_8_decode(struct chip8_context *ctx);
-static void op_8xy0(struct chip8_context *ctx); /* LD Vx, Vy */
-static void op_8xy1(struct chip8_context *ctx); /* OR Vx, Vy */
-static void op_8xy2(struct chip8_context *ctx); /* AND Vx, Vy */
-static void op_8xy3(struct chip8_context *ctx); /* XOR Vx, Vy */
-static void op_8xy4(struct chip8_context *ctx); /* ADD Vx, Vy */
-static void op_8xy5(struct chip8_context *ctx); /* SUB Vx, Vy */
-static void op_8xy6(struct chip8_context *ctx); /* SHR Vx {, Vy} */
-static void op_8xy7(struct chip8_context *ctx); /* SUBN Vx, Vy */
-static void op_8xyE(struct chip8_context *ctx); /* SHL Vx {, Vy} */
-
-static void op_9xy0(struct chip8_context *ctx); /* SNE Vx, Vy */
-static void op_Annn(struct chip8_context *ctx); /* LD I, addr */
-static void op_Bnnn(struct chip8_context *ctx); /* JP V0, addr */
-static void op_Cxkk(struct chip8_context *ctx); /* RND Vx, byte */
-static void op_Dxyn(struct chip8_context *ctx); /* DRW Vx, Vy, nibble */
-
-static void op_E_decode(struct chip8_context *ctx);
-static void op_Ex9E(struct chip8_context *ctx); /* SKP Vx */
-static void op_ExA1(struct chip8_context *ctx); /* SKNP Vx */
-
-static void op_F_decode(struct chip8_context *ctx);
-static void op_Fx07(struct chip8_context *ctx); /* LD Vx, DT */
-static void op_Fx0A(struct chip8_context *ctx); /* LD Vx, K */
-static void op_Fx15(struct chip8_context *ctx); /* LD DT, Vx */
-static void op_Fx18(struct chip8_context *ctx); /* LD ST, Vx */
-static void op_Fx1E(struct chip8_context *ctx); /* ADD I, Vx */
-static void op_Fx29(struct chip8_context *ctx); /* LD F, Vx */
-static void op_Fx33(struct chip8_context *ctx); /* LD B, Vx */
-static void op_Fx55(struct chip8_context *ctx); /* LD [I], Vx */
-static void op_Fx65(struct chip8_context *ctx); /* LD Vx, [I] */
+#if CHIP8_PROFILE
+#define PROFILE_HIT(ctx, addr, op) \
+    do { \
+        if ((ctx)->profile) { \
+            (ctx)->profile->cycles++; \
+            (ctx)->profile->op_counts[op]++; \
+            (ctx)->profile->pc_counts[addr]++; \
+        } \
+    } while (0)
+#else
+#define PROFILE_HIT(ctx, addr, op) ((void)0)
+#endif
+
+#if CHIP8_SAFE
+/* Addresses and key numbers wrap like the original machine's */
+#define MEM_ADDR(addr) ((addr) & (RAM_SIZE - 1))
+#define KEY_INDEX(key) ((key) & 0xF)
+
+/* Stops the machine on the current instruction if cond holds */
+#define FAULT_CHECK(ctx, cond, type) \
+    do { \
+        if (cond) { \
+            fault_raise(ctx, type); \
+            return; \
+        } \
+    } while (0)
+
+#define FAULT_TYPE(ctx) ((ctx)->fault.type)
+#else
+#define MEM_ADDR(addr) (addr)
+#define KEY_INDEX(key) (key)
+#define FAULT_CHECK(ctx, cond, type) ((void)0)
+#define FAULT_TYPE(ctx) CHIP8_FAULT_NONE
+#endif
+
+static void display_touch(struct chip8_context *ctx, int left, int top,
+                          int right, int bottom);
+static uint64_t display_draw_row(uint64_t *row, uint64_t bits, unsigned x,
+                                 int clip);
+static uint64_t display_double(uint64_t bits);
+static void display_scroll(struct chip8_context *ctx, int down, int right);
+#if CHIP8_SAFE
+static void fault_raise(struct chip8_context *ctx, uint8_t type);
+#endif
+
+static uint8_t decode_op(uint16_t opcode);
+static uint32_t rng_next(struct chip8_context *ctx);
+
+static const char *const op_mnemonics[CHIP8_OP_COUNT] = {
+#define OP_MNEMONIC_ENTRY(name, mnemonic, flags) mnemonic,
+    CHIP8_OPS(OP_MNEMONIC_ENTRY)
+#undef OP_MNEMONIC_ENTRY
+};
+
+static const uint8_t op_flags[CHIP8_OP_COUNT] = {
+#define OP_FLAGS_ENTRY(name, mnemonic, flags) flags,
+    CHIP8_OPS(OP_FLAGS_ENTRY)
+#undef OP_FLAGS_ENTRY
+};
+
+/* Each profile's quirks as a constant, for QUIRK() in chip8_interp.h */
+enum {
+#define QUIRK_FLAGS_ENUM(name, quirks) QUIRK_FLAGS_##name = (quirks),
+    CHIP8_QUIRK_PROFILES(QUIRK_FLAGS_ENUM)
+#undef QUIRK_FLAGS_ENUM
+};
+
+static const uint8_t quirk_flags[CHIP8_QUIRKS_COUNT] = {
+#define QUIRK_FLAGS_ENTRY(name, quirks) QUIRK_FLAGS_##name,
+    CHIP8_QUIRK_PROFILES(QUIRK_FLAGS_ENTRY)
+#undef QUIRK_FLAGS_ENTRY
+};
+
+static const char *const quirk_names[CHIP8_QUIRKS_COUNT] = {
+#define QUIRK_NAME_ENTRY(name, quirks) #name,
+    CHIP8_QUIRK_PROFILES(QUIRK_NAME_ENTRY)
+#undef QUIRK_NAME_ENTRY
+};
+
+/* Power-on state copied by chip8_init and chip8_reset */
+static struct chip8_context pristine;
+static int pristine_ready;
+
+static void pristine_init(void);
+
+#if CHIP8_DISPATCH != CHIP8_DISPATCH_TABLE
+/* Every possible opcode decoded up front (512KB), filled by chip8_init */
+static struct chip8_insn decode_table[0xFFFF + 1];
+
+static void decode_table_init(void);
+#endif
+
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_GOTO && !defined(__GNUC__)
+#error "CHIP8_DISPATCH_GOTO needs the labels-as-values extension"
+#endif
+
+/* One interpreter per entry of CHIP8_QUIRK_PROFILES */
+#define QUIRKS none
+#include "chip8_interp.h"
+#undef QUIRKS
+
+#define QUIRKS chip8
+#include "chip8_interp.h"
+#undef QUIRKS
+
+#define QUIRKS schip
+#include "chip8_interp.h"
+#undef QUIRKS
+
+#define QUIRKS xochip
+#include "chip8_interp.h"
+#undef QUIRKS
+
+struct interp {
+    int (*cycle)(struct chip8_context *ctx);
+    int (*run)(struct chip8_context *ctx, uint32_t cycles);
+    int (*exec)(struct chip8_context *ctx, const struct chip8_insn *insn);
+};
+
+/* Indexed by enum chip8_quirks */
+static const struct interp interps[CHIP8_QUIRKS_COUNT] = {
+#define INTERP_ENTRY(name, quirks) \
+    { &cycle_##name, &run_##name, &exec_##name },
+    CHIP8_QUIRK_PROFILES(INTERP_ENTRY)
+#undef INTERP_ENTRY
+};
+
+#define INTERP(ctx) \
+    (&interps[(ctx)->quirks < CHIP8_QUIRKS_COUNT ? (ctx)->quirks : 0])
 
 int chip8_init(struct chip8_context *ctx)
 {
+    if (!pristine_ready) {
+        pristine_init();
+    }
+
+    memcpy(ctx, &pristine, sizeof(*ctx));
+
+    return 0;
+}
+
+void chip8_reset(struct chip8_context *ctx)
+{
+    /* Power-on state, keeping the program in memory, the keys, the seed
+     * and any profile: two copies from the template, one for the fields
+     * before keys and one for the memory below the program */
+    memcpy(ctx, &pristine, offsetof(struct chip8_context, keys));
+    memcpy(ctx->mem, pristine.mem, PROGRAM_START);
+
+#if CHIP8_SAFE
+    memset(&ctx->fault, 0, sizeof(ctx->fault));
+#endif
+
+    chip8_seed(ctx, ctx->seed);
+    display_touch(ctx, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+}
+
+void chip8_clone(struct chip8_context *dst, const struct chip8_context *src)
+{
+    /* Everything up to the end of mem; dst keeps its profile, and its
+     * display generation so frontends see the new screen */
+    uint32_t display_gen = dst->display_gen;
+
+    memcpy(dst, src, offsetof(struct chip8_context, mem) + RAM_SIZE);
+
+#if CHIP8_SAFE
+    dst->fault = src->fault;
+#endif
+
+    dst->display_gen = display_gen;
+    display_touch(dst, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+}
+
+static void pristine_init(void)
+{
+    /* Shared by all contexts; the first chip8_init should happen before
+     * contexts are handed to other threads */
+    struct chip8_context *ctx = &pristine;
+
     memset(ctx, 0, sizeof(*ctx));
 
     /* Initialise font sprites */
@@ -86,506 +211,650 @@ int chip8_init(struct chip8_context *ctx)
 
     memcpy(&ctx->mem[0], fonts, sizeof(fonts));
 
-    /* Initialise opcode table */
-    ctx->opcode_table[0x0] = &op_0_decode;
-    ctx->opcode_table[0x1] = &op_1nnn;
-    ctx->opcode_table[0x2] = &op_2nnn;
-    ctx->opcode_table[0x3] = &op_3xkk;
-    ctx->opcode_table[0x4] = &op_4xkk;
-    ctx->opcode_table[0x5] = &op_5xy0;
-    ctx->opcode_table[0x6] = &op_6xkk;
-    ctx->opcode_table[0x7] = &op_7xkk;
-    ctx->opcode_table[0x8] = &op_8_decode;
-    ctx->opcode_table[0x9] = &op_9xy0;
-    ctx->opcode_table[0xA] = &op_Annn;
-    ctx->opcode_table[0xB] = &op_Bnnn;
-    ctx->opcode_table[0xC] = &op_Cxkk;
-    ctx->opcode_table[0xD] = &op_Dxyn;
-    ctx->opcode_table[0xE] = &op_E_decode;
-    ctx->opcode_table[0xF] = &op_F_decode;
+    chip8_display_clean(ctx);
+    ctx->planes = 1;
+
+#if CHIP8_DISPATCH != CHIP8_DISPATCH_TABLE
+    decode_table_init();
+#endif
 
     ctx->pc = PROGRAM_START;
 
-    return 0;
+    /* Deterministic until the frontend reseeds */
+    chip8_seed(ctx, CHIP8_DEFAULT_SEED);
+
+    pristine_ready = 1;
 }
 
-void chip8_loadrom(struct chip8_context *ctx, const char *filepath)
+int chip8_loadrom(struct chip8_context *ctx, const char *filepath)
 {
+    /* Returns a chip8_rom_status; mem is left alone unless the size is
+     * valid, then the file is read straight into it */
     FILE *f = NULL;
+    long size;
+
+    if ((f = fopen(filepath, "rb")) == NULL) {
+        return CHIP8_ROM_OPEN_FAILED;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0
+        || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return CHIP8_ROM_READ_FAILED;
+    }
+
+    if (size == 0 || size > CHIP8_ROM_MAX) {
+        fclose(f);
+        return size == 0 ? CHIP8_ROM_EMPTY : CHIP8_ROM_TOO_LARGE;
+    }
 
     /* Clear current program */
     ctx->pc = PROGRAM_START;
-    memset(&ctx->mem[PROGRAM_START], 0, PROGRAM_END - PROGRAM_START);
+    memset(&ctx->mem[PROGRAM_START + size], 0, CHIP8_ROM_MAX - size);
 
-    if ((f = fopen(filepath, "rb")) != NULL) {
-        char buffer[PROGRAM_END - PROGRAM_START];
-        size_t bytes_read = 0;
+    if (fread(&ctx->mem[PROGRAM_START], 1, (size_t)size, f) != (size_t)size) {
+        memset(&ctx->mem[PROGRAM_START], 0, CHIP8_ROM_MAX);
+        fclose(f);
+        return CHIP8_ROM_READ_FAILED;
+    }
 
-        bytes_read = fread(buffer, 1, sizeof(buffer), f);
-        memcpy(&ctx->mem[PROGRAM_START], buffer, bytes_read);
+    fclose(f);
 
-        fclose(f);
+    return CHIP8_ROM_OK;
+}
+
+int chip8_loadrom_mem(struct chip8_context *ctx, const uint8_t *rom,
+                      size_t size)
+{
+    /* Same as chip8_loadrom for an image already in memory */
+    if (size == 0 || size > CHIP8_ROM_MAX) {
+        return size == 0 ? CHIP8_ROM_EMPTY : CHIP8_ROM_TOO_LARGE;
     }
+
+    ctx->pc = PROGRAM_START;
+    memcpy(&ctx->mem[PROGRAM_START], rom, size);
+    memset(&ctx->mem[PROGRAM_START + size], 0, CHIP8_ROM_MAX - size);
+
+    return CHIP8_ROM_OK;
 }
 
-void chip8_cycle(struct chip8_context *ctx)
+const char *chip8_rom_status_string(int status)
 {
-    if (ctx->pc < PROGRAM_END) {
-        ctx->opcode = (ctx->mem[ctx->pc] << 8u) | ctx->mem[ctx->pc + 1];
+    switch (status) {
+    case CHIP8_ROM_OK:
+        return "ok";
 
-        /* printf("[%03x] %04x\n", ctx->pc, ctx->opcode); */
+    case CHIP8_ROM_OPEN_FAILED:
+        return "could not open file";
 
-        ctx->pc += 2;
+    case CHIP8_ROM_READ_FAILED:
+        return "could not read file";
 
-        if (ctx->opcode) {
-            ctx->opcode_table[ctx->opcode >> 12u](ctx);
-        }
+    case CHIP8_ROM_EMPTY:
+        return "file is empty";
+
+    case CHIP8_ROM_TOO_LARGE:
+        return "too large to fit in memory";
+
+    default:
+        return "unknown error";
     }
 }
 
-static void op_invalid(struct chip8_context *ctx)
+const char *chip8_fault_string(int type)
 {
-    printf("Unhandled instruction.\n");
-}
+    switch (type) {
+    case CHIP8_FAULT_NONE:
+        return "none";
 
-static void op_0_decode(struct chip8_context *ctx)
-{
-    switch (ctx->opcode & 0x00FFu) {
-    case 0xE0:
-        op_00E0(ctx);
-        break;
+    case CHIP8_FAULT_STACK_OVERFLOW:
+        return "stack overflow";
+
+    case CHIP8_FAULT_STACK_UNDERFLOW:
+        return "stack underflow";
 
-    case 0xEE:
-        op_00EE(ctx);
-        break;
+    case CHIP8_FAULT_INVALID_OPCODE:
+        return "invalid opcode";
 
     default:
-        op_invalid(ctx);
+        return "unknown fault";
     }
 }
 
-static void op_0nnn(struct chip8_context *ctx)
+uint64_t chip8_hash(const void *data, size_t size)
 {
-    /* SYS addr */
+    /* FNV-1a, used to identify ROMs and compare displays */
+    const uint8_t *bytes = data;
+    uint64_t hash = 0xCBF29CE484222325u;
+
+    for (size_t b = 0; b < size; ++b) {
+        hash ^= bytes[b];
+        hash *= 0x100000001B3u;
+    }
+
+    return hash;
 }
 
-static void op_00E0(struct chip8_context *ctx)
+uint64_t chip8_program_hash(const struct chip8_context *ctx)
 {
-    /* CLS */
-    memset(ctx->display, 0, DISPLAY_SIZE * sizeof(uint32_t));
+    /* The program area, so the ROM is identified whatever file it came
+     * from and however many trailing zeros it has; keys the quirk
+     * database and replay files */
+    return chip8_hash(&ctx->mem[PROGRAM_START], CHIP8_ROM_MAX);
 }
 
-static void op_00EE(struct chip8_context *ctx)
+size_t chip8_sprite_size(const struct chip8_context *ctx, uint8_t n)
 {
-    /* RET */
-    ctx->pc = ctx->stack[--ctx->sp];
+    /* Bytes a DRW of height n reads from I: a byte per row, or 16 rows of
+     * two bytes for Dxy0 from SCHIP up, for each selected plane */
+    size_t size = n;
+    size_t total = 0;
+
+#if CHIP8_VARIANT != CHIP8_VARIANT_CHIP8
+    if (n == 0) {
+        size = 32;
+    }
+#endif
+
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        if (ctx->planes & (1u << plane)) {
+            total += size;
+        }
+    }
+
+    return total;
 }
 
-static void op_1nnn(struct chip8_context *ctx)
+int chip8_cycle(struct chip8_context *ctx)
 {
-    /* JP addr */
-    ctx->pc = ctx->opcode & 0x0FFFu;
+    /* Returns a chip8_fault_type, and does nothing once the machine has
+     * faulted */
+    return INTERP(ctx)->cycle(ctx);
 }
 
-static void op_2nnn(struct chip8_context *ctx)
+int chip8_run(struct chip8_context *ctx, uint32_t cycles)
 {
-    /* CALL addr */
-    ctx->stack[ctx->sp++] = ctx->pc;
-    ctx->pc = ctx->opcode & 0x0FFFu;
+    /* The profile is looked up once per call, not per instruction */
+    return INTERP(ctx)->run(ctx, cycles);
 }
 
-static void op_3xkk(struct chip8_context *ctx)
+int chip8_exec(struct chip8_context *ctx, const struct chip8_insn *insn)
 {
-    /* SE Vx, byte */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t byte = ctx->opcode & 0x00FFu;
-
-    if (ctx->registers[x] == byte) {
-        ctx->pc += 2;
-    }
+    /* Same as chip8_cycle, for an instruction already decoded from pc */
+    return INTERP(ctx)->exec(ctx, insn);
 }
 
-static void op_4xkk(struct chip8_context *ctx)
+void chip8_decode(uint16_t opcode, struct chip8_insn *insn)
 {
-    /* SNE Vx, byte */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t byte = ctx->opcode & 0x00FFu;
-
-    if (ctx->registers[x] != byte) {
-        ctx->pc += 2;
-    }
+    insn->opcode = opcode;
+    insn->nnn = opcode & 0x0FFFu;
+    insn->op = decode_op(opcode);
+    insn->x = (opcode & 0x0F00u) >> 8u;
+    insn->y = (opcode & 0x00F0u) >> 4u;
+    insn->kk = opcode & 0x00FFu;
 }
 
-static void op_5xy0(struct chip8_context *ctx)
+uint8_t chip8_op_flags(uint8_t op)
 {
-    /* SE Vx, Vy */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
-
-    if (ctx->registers[x] == ctx->registers[y]) {
-        ctx->pc += 2;
-    }
+    return op < CHIP8_OP_COUNT ? op_flags[op] : 0;
 }
 
-static void op_6xkk(struct chip8_context *ctx)
+uint8_t chip8_quirk_flags(int quirks)
 {
-    /* LD Vx, byte */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-
-    ctx->registers[x] = ctx->opcode & 0x00FFu;
+    /* CHIP8_QUIRK_* bits of a profile */
+    return quirks >= 0 && quirks < CHIP8_QUIRKS_COUNT ? quirk_flags[quirks]
+                                                      : 0;
 }
 
-static void op_7xkk(struct chip8_context *ctx)
+const char *chip8_quirks_name(int quirks)
 {
-    /* ADD Vx, byte */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-
-    ctx->registers[x] += ctx->opcode & 0x00FFu;
+    return quirks >= 0 && quirks < CHIP8_QUIRKS_COUNT ? quirk_names[quirks]
+                                                      : "unknown";
 }
 
-static void op_8_decode(struct chip8_context *ctx)
+int chip8_quirks_parse(const char *name)
 {
-    switch (ctx->opcode & 0x000Fu) {
-    case 0x0:
-        op_8xy0(ctx);
-        break;
-
-    case 0x1:
-        op_8xy1(ctx);
-        break;
+    /* The profile with this name, or -1 */
+    for (int q = 0; q < CHIP8_QUIRKS_COUNT; ++q) {
+        if (strcmp(name, quirk_names[q]) == 0) {
+            return q;
+        }
+    }
 
-    case 0x2:
-        op_8xy2(ctx);
-        break;
+    return -1;
+}
+
+const char *chip8_op_mnemonic(uint8_t op)
+{
+    return op_mnemonics[op < CHIP8_OP_COUNT ? op : CHIP8_OP_invalid];
+}
+
+void chip8_disasm(const struct chip8_insn *insn, char *buf, size_t size)
+{
+    /* Fill the operand placeholders of the mnemonic, e.g. "ADD Vx, byte" */
+    const char *src = chip8_op_mnemonic(insn->op);
+    size_t len = 0;
+
+    while (*src && len + 8 < size) {
+        if (strncmp(src, "Vx", 2) == 0) {
+            len += sprintf(&buf[len], "V%X", insn->x);
+            src += 2;
+        } else if (strncmp(src, "Vy", 2) == 0) {
+            len += sprintf(&buf[len], "V%X", insn->y);
+            src += 2;
+        } else if (strncmp(src, "byte", 4) == 0) {
+            len += sprintf(&buf[len], "#%02X", insn->kk);
+            src += 4;
+        } else if (strncmp(src, "addr", 4) == 0) {
+            len += sprintf(&buf[len], "%03X", insn->nnn);
+            src += 4;
+        } else if (strncmp(src, "nibble", 6) == 0) {
+            len += sprintf(&buf[len], "%X", insn->kk & 0x0Fu);
+            src += 6;
+        } else if (strncmp(src, "mask", 4) == 0) {
+            len += sprintf(&buf[len], "%X", insn->x);
+            src += 4;
+        } else {
+            buf[len++] = *src++;
+        }
+    }
 
-    case 0x3:
-        op_8xy3(ctx);
-        break;
+    if (size > 0) {
+        buf[len < size ? len : size - 1] = '\0';
+    }
+}
 
-    case 0x4:
-        op_8xy4(ctx);
-        break;
+static uint8_t decode_op(uint16_t opcode)
+{
+    /* Mirrors opcode_table and the op_*_decode functions */
+    switch (opcode >> 12u) {
+    case 0x0:
+        switch (opcode & 0x00FFu) {
+        case 0x00:
+            /* Q(cycle) skips a zero opcode before op_0_decode sees it */
+            return opcode == 0x0000 ? CHIP8_OP_0nnn : CHIP8_OP_invalid;
+
+        case 0xE0: return CHIP8_OP_00E0;
+        case 0xEE: return CHIP8_OP_00EE;
+#if CHIP8_VARIANT != CHIP8_VARIANT_CHIP8
+        case 0xFB: return CHIP8_OP_00FB;
+        case 0xFC: return CHIP8_OP_00FC;
+        case 0xFD: return CHIP8_OP_00FD;
+        case 0xFE: return CHIP8_OP_00FE;
+        case 0xFF: return CHIP8_OP_00FF;
+#endif
+        default: break;
+        }
 
-    case 0x5:
-        op_8xy5(ctx);
-        break;
+#if CHIP8_VARIANT != CHIP8_VARIANT_CHIP8
+        if ((opcode & 0x00F0u) == 0x00C0u) {
+            return CHIP8_OP_00Cn;
+        }
+#endif
 
-    case 0x6:
-        op_8xy6(ctx);
-        break;
+#if CHIP8_VARIANT == CHIP8_VARIANT_XOCHIP
+        if ((opcode & 0x00F0u) == 0x00D0u) {
+            return CHIP8_OP_00Dn;
+        }
+#endif
+
+        return CHIP8_OP_invalid;
+
+    case 0x1: return CHIP8_OP_1nnn;
+    case 0x2: return CHIP8_OP_2nnn;
+    case 0x3: return CHIP8_OP_3xkk;
+    case 0x4: return CHIP8_OP_4xkk;
+    case 0x5: return CHIP8_OP_5xy0;
+    case 0x6: return CHIP8_OP_6xkk;
+    case 0x7: return CHIP8_OP_7xkk;
+
+    case 0x8:
+        switch (opcode & 0x000Fu) {
+        case 0x0: return CHIP8_OP_8xy0;
+        case 0x1: return CHIP8_OP_8xy1;
+        case 0x2: return CHIP8_OP_8xy2;
+        case 0x3: return CHIP8_OP_8xy3;
+        case 0x4: return CHIP8_OP_8xy4;
+        case 0x5: return CHIP8_OP_8xy5;
+        case 0x6: return CHIP8_OP_8xy6;
+        case 0x7: return CHIP8_OP_8xy7;
+        case 0xE: return CHIP8_OP_8xyE;
+        default: return CHIP8_OP_invalid;
+        }
 
-    case 0x7:
-        op_8xy7(ctx);
-        break;
+    case 0x9: return CHIP8_OP_9xy0;
+    case 0xA: return CHIP8_OP_Annn;
+    case 0xB: return CHIP8_OP_Bnnn;
+    case 0xC: return CHIP8_OP_Cxkk;
+    case 0xD: return CHIP8_OP_Dxyn;
 
     case 0xE:
-        op_8xyE(ctx);
-        break;
+        switch (opcode & 0x00FFu) {
+        case 0x9E: return CHIP8_OP_Ex9E;
+        case 0xA1: return CHIP8_OP_ExA1;
+        default: return CHIP8_OP_invalid;
+        }
 
     default:
-        op_invalid(ctx);
-        break;
+        switch (opcode & 0x00FFu) {
+#if CHIP8_VARIANT == CHIP8_VARIANT_XOCHIP
+        case 0x00:
+            return opcode == 0xF000 ? CHIP8_OP_F000 : CHIP8_OP_invalid;
+
+        case 0x01: return CHIP8_OP_Fx01;
+#endif
+        case 0x07: return CHIP8_OP_Fx07;
+        case 0x0A: return CHIP8_OP_Fx0A;
+        case 0x15: return CHIP8_OP_Fx15;
+        case 0x18: return CHIP8_OP_Fx18;
+        case 0x1E: return CHIP8_OP_Fx1E;
+        case 0x29: return CHIP8_OP_Fx29;
+        case 0x33: return CHIP8_OP_Fx33;
+        case 0x55: return CHIP8_OP_Fx55;
+        case 0x65: return CHIP8_OP_Fx65;
+        default: return CHIP8_OP_invalid;
+        }
     }
 }
 
-static void op_8xy0(struct chip8_context *ctx)
+#if CHIP8_DISPATCH != CHIP8_DISPATCH_TABLE
+static void decode_table_init(void)
 {
-    /* LD Vx, Vy */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
-
-    ctx->registers[x] = ctx->registers[y];
+    for (uint32_t opcode = 0; opcode <= 0xFFFF; ++opcode) {
+        chip8_decode((uint16_t)opcode, &decode_table[opcode]);
+    }
 }
+#endif
 
-static void op_8xy1(struct chip8_context *ctx)
+void chip8_seed(struct chip8_context *ctx, uint64_t seed)
 {
-    /* OR Vx, Vy */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
-
-    ctx->registers[x] |= ctx->registers[y];
+    /* PCG32 seeding: step, add the seed, step */
+    ctx->seed = seed;
+    ctx->rng = 0;
+    rng_next(ctx);
+    ctx->rng += seed;
+    rng_next(ctx);
 }
 
-static void op_8xy2(struct chip8_context *ctx)
+static uint32_t rng_next(struct chip8_context *ctx)
 {
-    /* AND Vx, Vy */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
-
-    ctx->registers[x] &= ctx->registers[y];
-}
+    /* PCG32 (XSH RR), https://www.pcg-random.org */
+    uint64_t old = ctx->rng;
+    uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = (uint32_t)(old >> 59u);
 
-static void op_8xy3(struct chip8_context *ctx)
-{
-    /* XOR Vx, Vy */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
+    ctx->rng = old * 6364136223846793005u + 1442695040888963407u;
 
-    ctx->registers[x] ^= ctx->registers[y];
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31u));
 }
 
-static void op_8xy4(struct chip8_context *ctx)
+void chip8_tick_timers(struct chip8_context *ctx)
 {
-    /* ADD Vx, Vy */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
-    uint16_t res = ctx->registers[x] + ctx->registers[y];
+    /* Called at 60Hz by the frontend */
+    if (ctx->delay_timer > 0) {
+        ctx->delay_timer--;
+    }
 
-    ctx->registers[0xF] = res > 255 ? 1 : 0;
-    ctx->registers[x] = res & 0x00FFu;
+    /* The frontend beeps while the sound timer is nonzero */
+    if (ctx->sound_timer > 0) {
+        ctx->sound_timer--;
+    }
 }
 
-static void op_8xy5(struct chip8_context *ctx)
+int chip8_frame(struct chip8_context *ctx, uint32_t cycles)
 {
-    /* SUB Vx, Vy */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
+    /* One 60Hz frame: a batch of instructions, then a single timer tick */
+    int fault = chip8_run(ctx, cycles);
+
+    chip8_tick_timers(ctx);
 
-    ctx->registers[0xF] = x > y ? 1 : 0;
-    ctx->registers[x] -= ctx->registers[y];
+    return fault;
 }
 
-static void op_8xy6(struct chip8_context *ctx)
+void chip8_display_clean(struct chip8_context *ctx)
 {
-    /* SHR Vx, {, Vy} */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-
-    ctx->registers[0xF] = ctx->registers[x] & 0x1 ? 1 : 0;
-    ctx->registers[x] >>= 1;
+    /* Empty rectangle: left > right */
+    ctx->dirty_left = DISPLAY_WIDTH;
+    ctx->dirty_top = DISPLAY_HEIGHT;
+    ctx->dirty_right = 0;
+    ctx->dirty_bottom = 0;
 }
 
-static void op_8xy7(struct chip8_context *ctx)
+size_t chip8_save_state(const struct chip8_context *ctx, uint8_t *buf,
+                        size_t size)
 {
-    /* SUBN Vx, Vy */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
+    /* Returns the bytes written (CHIP8_STATE_SIZE), 0 if buf is too small.
+     * Only machine state is saved: no pointers, dirty tracking or profile,
+     * so a state can be loaded into any context in any process. */
+    uint8_t *p = buf;
 
-    ctx->registers[0xF] = ctx->registers[y] > ctx->registers[x] ? 1 : 0;
-    ctx->registers[x] = ctx->registers[y] - ctx->registers[x];
-}
+    if (size < CHIP8_STATE_SIZE) {
+        return 0;
+    }
 
-static void op_8xyE(struct chip8_context *ctx)
-{
-    /* SHL Vx, {, Vy} */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
+    memcpy(p, "C8ST", 4);
+    p = put_u16(p + 4, CHIP8_STATE_VERSION);
+    p = put_u16(p, CHIP8_VARIANT);
+
+    p = put_u16(p, ctx->pc);
+    p = put_u16(p, ctx->i);
+    p = put_u16(p, ctx->opcode);
+    *p++ = ctx->sp;
+    *p++ = ctx->delay_timer;
+    *p++ = ctx->sound_timer;
+    *p++ = ctx->hires;
+    *p++ = ctx->planes;
+
+    for (int s = 0; s < STACK_SIZE; ++s) {
+        p = put_u16(p, ctx->stack[s]);
+    }
 
-    ctx->registers[0xF] = ctx->registers[x] & 128u ? 1 : 0;
-    ctx->registers[x] <<= 1;
-}
+    memcpy(p, ctx->registers, 16);
+    p += 16;
+    memcpy(p, ctx->keys, 16);
+    p += 16;
 
-static void op_9xy0(struct chip8_context *ctx)
-{
-    /* SNE Vx, Vy */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
+    p = put_u64(p, ctx->rng);
 
-    if (ctx->registers[x] != ctx->registers[y]) {
-        ctx->pc += 2;
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        for (int row = 0; row < DISPLAY_HEIGHT; ++row) {
+            for (int w = 0; w < DISPLAY_WORDS; ++w) {
+                p = put_u64(p, ctx->display[plane][row][w]);
+            }
+        }
     }
-}
 
-static void op_Annn(struct chip8_context *ctx)
-{
-    /* LD I, addr */
-    ctx->i = ctx->opcode & 0x0FFFu;
-}
+    memcpy(p, ctx->mem, RAM_SIZE);
+    p += RAM_SIZE;
 
-static void op_Bnnn(struct chip8_context *ctx)
-{
-    /* JP V0, addr */
-    ctx->pc = (ctx->opcode & 0x0FFFu) + ctx->registers[0x0];
+    return (size_t)(p - buf);
 }
 
-static void op_Cxkk(struct chip8_context *ctx)
+int chip8_load_state(struct chip8_context *ctx, const uint8_t *buf,
+                     size_t size)
 {
-    /* RND Vx, byte */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
+    /* Returns 0 on success. Nothing is changed if the state is rejected. */
+    const uint8_t *p = buf;
 
-    srand(time(NULL));
-    ctx->registers[x] = (uint8_t)(rand()) & (ctx->opcode & 0x00FFu);
-}
+    if (size < CHIP8_STATE_SIZE
+        || memcmp(p, "C8ST", 4) != 0
+        || get_u16(p + 4) != CHIP8_STATE_VERSION
+        || get_u16(p + 6) != CHIP8_VARIANT
+        || p[8 + 6] > STACK_SIZE) {
+        return 1;
+    }
 
-static void op_Dxyn(struct chip8_context *ctx)
-{
-    /* DRW Vx, Vy, nibble */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    uint8_t y = (ctx->opcode & 0x00F0u) >> 4u;
-    uint8_t n = (ctx->opcode & 0x000Fu);
+    p += 8;
 
-    uint8_t *sprite = &ctx->mem[ctx->i];
-    uint8_t x_origin = ctx->registers[x];
-    uint8_t y_origin = ctx->registers[y];
+    ctx->pc = get_u16(p);
+    ctx->i = get_u16(p + 2);
+    ctx->opcode = get_u16(p + 4);
+    ctx->sp = p[6];
+    ctx->delay_timer = p[7];
+    ctx->sound_timer = p[8];
+    ctx->hires = p[9] != 0;
+    ctx->planes = p[10] & ((1u << DISPLAY_PLANES) - 1);
+    p += 11;
 
-    /* TODO: If outside display, wrap around screen */
+    for (int s = 0; s < STACK_SIZE; ++s, p += 2) {
+        ctx->stack[s] = get_u16(p);
+    }
 
-    for (uint8_t row = 0; row < n; ++row) {
-        for (uint8_t col = 0; col < 8; ++col) {
-            if (sprite[row] & (128 >> col)) {
-                uint32_t *px = &ctx->display[(y_origin + row)
-                                             * DISPLAY_WIDTH + x_origin + col];
+    memcpy(ctx->registers, p, 16);
+    p += 16;
+    memcpy(ctx->keys, p, 16);
+    p += 16;
 
-                if (*px == 0xFFFFFFFF) {
-                    ctx->registers[0xF] = 1;
-                }
+    ctx->rng = get_u64(p);
+    p += 8;
 
-                *px ^= 0xFFFFFFFF;
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        for (int row = 0; row < DISPLAY_HEIGHT; ++row) {
+            for (int w = 0; w < DISPLAY_WORDS; ++w, p += 8) {
+                ctx->display[plane][row][w] = get_u64(p);
             }
         }
     }
-}
 
-static void op_E_decode(struct chip8_context *ctx)
-{
-    switch (ctx->opcode & 0x00FFu) {
-    case 0x9E:
-        op_Ex9E(ctx);
-        break;
+    memcpy(ctx->mem, p, RAM_SIZE);
 
-    case 0xA1:
-        op_ExA1(ctx);
-        break;
+#if CHIP8_SAFE
+    memset(&ctx->fault, 0, sizeof(ctx->fault));
+#endif
 
-    default:
-        op_invalid(ctx);
-        break;
-    }
-}
+    /* The whole screen may have changed */
+    display_touch(ctx, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
 
-static void op_Ex9E(struct chip8_context *ctx)
-{
-    /* SKP Vx */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-
-    if (ctx->keys[ctx->registers[x]]) {
-        ctx->pc += 2;
-    }
+    return 0;
 }
 
-static void op_ExA1(struct chip8_context *ctx)
+static void display_touch(struct chip8_context *ctx, int left, int top,
+                          int right, int bottom)
 {
-    /* SKNP Vx */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-
-    if (!ctx->keys[ctx->registers[x]]) {
-        ctx->pc += 2;
+    /* Grow the dirty rectangle by [left, right) x [top, bottom) */
+    if (right > DISPLAY_WIDTH) {
+        right = DISPLAY_WIDTH;
     }
-}
 
-static void op_F_decode(struct chip8_context *ctx)
-{
-    switch (ctx->opcode & 0x00FFu) {
-    case 0x07:
-        op_Fx07(ctx);
-        break;
-
-    case 0x0A:
-        op_Fx0A(ctx);
-        break;
-
-    case 0x15:
-        op_Fx15(ctx);
-        break;
-
-    case 0x18:
-        op_Fx18(ctx);
-        break;
-
-    case 0x1E:
-        op_Fx1E(ctx);
-        break;
+    if (bottom > DISPLAY_HEIGHT) {
+        bottom = DISPLAY_HEIGHT;
+    }
 
-    case 0x29:
-        op_Fx29(ctx);
-        break;
+    if (left >= right || top >= bottom) {
+        return;
+    }
 
-    case 0x33:
-        op_Fx33(ctx);
-        break;
+    if (left < ctx->dirty_left) {
+        ctx->dirty_left = left;
+    }
 
-    case 0x55:
-        op_Fx55(ctx);
-        break;
+    if (top < ctx->dirty_top) {
+        ctx->dirty_top = top;
+    }
 
-    case 0x65:
-        op_Fx65(ctx);
-        break;
+    if (right > ctx->dirty_right) {
+        ctx->dirty_right = right;
+    }
 
-    default:
-        op_invalid(ctx);
-        break;
+    if (bottom > ctx->dirty_bottom) {
+        ctx->dirty_bottom = bottom;
     }
-}
 
-static void op_Fx07(struct chip8_context *ctx)
-{
-    /* LD Vx, DT */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    ctx->registers[x] = ctx->delay_timer;
+    ctx->display_gen++;
 }
 
-static void op_Fx0A(struct chip8_context *ctx)
+static uint64_t display_draw_row(uint64_t *row, uint64_t bits, unsigned x,
+                                 int clip)
 {
-    /* LD Vx, K */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
+    /* XOR left-aligned sprite bits into a display row from pixel x, the
+     * part past the right edge wrapping to the left one unless clip is
+     * set. Returns the pixels the sprite turned off. */
+    unsigned word = x / 64 % DISPLAY_WORDS;
+    unsigned next = (word + 1) % DISPLAY_WORDS;
+    uint64_t first = bits >> (x % 64);
+    uint64_t rest = (bits << (63 - x % 64)) << 1;
+    uint64_t collision;
 
-    for (int i = 0; i < 0xF + 1; ++i) {
-        if (ctx->keys[i]) {
-            ctx->registers[x] = i;
-            return;
-        }
+    if (clip && next == 0) {
+        rest = 0;
     }
 
-    ctx->pc -= 2;
-}
+    if (DISPLAY_WORDS == 1) {
+        /* A single word: the sprite rotates within it */
+        first = clip ? first : bits >> (x % 64) | bits << (-x % 64);
+        rest = 0;
+    }
 
-static void op_Fx15(struct chip8_context *ctx)
-{
-    /* LD DT, Vx */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    ctx->delay_timer = ctx->registers[x];
-}
+    collision = row[word] & first;
+    row[word] ^= first;
+    collision |= row[next] & rest;
+    row[next] ^= rest;
 
-static void op_Fx18(struct chip8_context *ctx)
-{
-    /* LD ST, Vx */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-    ctx->sound_timer = ctx->registers[x];
+    return collision;
 }
 
-static void op_Fx1E(struct chip8_context *ctx)
+static uint64_t display_double(uint64_t bits)
 {
-    /* ADD I, Vx */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8;
-    ctx->i += ctx->registers[x];
-}
+    /* Each of the low 16 bits twice, for low resolution sprites */
+    bits = (bits | bits << 8) & 0x00FF00FFu;
+    bits = (bits | bits << 4) & 0x0F0F0F0Fu;
+    bits = (bits | bits << 2) & 0x33333333u;
+    bits = (bits | bits << 1) & 0x55555555u;
 
-static void op_Fx29(struct chip8_context *ctx)
-{
-    /* TODO drawing */
+    return bits | bits << 1;
 }
 
-static void op_Fx33(struct chip8_context *ctx)
+static void display_scroll(struct chip8_context *ctx, int down, int right)
 {
-    /* TODO drawing */
-}
+    /* Move the selected planes down (up if negative) by whole rows and
+     * right (left if negative) by under 64 pixels, a word shift per row
+     * word. What scrolls in is blank. */
+    size_t row_size = sizeof(ctx->display[0][0]);
 
-static void op_Fx55(struct chip8_context *ctx)
-{
-    /* LD [I], Vx */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        uint64_t (*rows)[DISPLAY_WORDS] = ctx->display[plane];
+
+        if (!(ctx->planes & (1u << plane))) {
+            continue;
+        }
+
+        if (down > 0) {
+            memmove(rows[down], rows[0], (DISPLAY_HEIGHT - down) * row_size);
+            memset(rows[0], 0, down * row_size);
+        } else if (down < 0) {
+            memmove(rows[0], rows[-down], (DISPLAY_HEIGHT + down) * row_size);
+            memset(rows[DISPLAY_HEIGHT + down], 0, -down * row_size);
+        }
+
+        for (int row = 0; right > 0 && row < DISPLAY_HEIGHT; ++row) {
+            for (int w = DISPLAY_WORDS - 1; w > 0; --w) {
+                rows[row][w] = rows[row][w] >> right
+                               | rows[row][w - 1] << (64 - right);
+            }
 
-    for (uint8_t j = 0; j < x; ++j) {
-        ctx->mem[ctx->i + j] = ctx->registers[j];
+            rows[row][0] >>= right;
+        }
+
+        for (int row = 0; right < 0 && row < DISPLAY_HEIGHT; ++row) {
+            for (int w = 0; w < DISPLAY_WORDS - 1; ++w) {
+                rows[row][w] = rows[row][w] << -right
+                               | rows[row][w + 1] >> (64 + right);
+            }
+
+            rows[row][DISPLAY_WORDS - 1] <<= -right;
+        }
     }
+
+    display_touch(ctx, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
 }
 
-static void op_Fx65(struct chip8_context *ctx)
+#if CHIP8_SAFE
+static void fault_raise(struct chip8_context *ctx, uint8_t type)
 {
-    /* LD Vx, [I] */
-    uint8_t x = (ctx->opcode & 0x0F00u) >> 8u;
-
-    for (uint8_t j = 0; j < x; ++j) {
-        ctx->registers[j] = ctx->mem[ctx->i + j];
-    }
+    /* Undo the fetch so pc stays on the faulting instruction */
+    ctx->pc -= 2;
+    ctx->fault.type = type;
+    ctx->fault.pc = ctx->pc;
+    ctx->fault.opcode = ctx->opcode;
 }
+#endif
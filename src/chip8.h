@@ -1,16 +1,238 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stddef.h>
 #include <stdint.h>
 
+/* Machine variant, chosen at build time with -DCHIP8_VARIANT=n; it sizes
+ * the display and memory and enables the variant's extra instructions */
+#define CHIP8_VARIANT_CHIP8 0  /* 64x32, 4KB */
+#define CHIP8_VARIANT_SCHIP 1  /* 128x64 hires mode, scrolling, 16x16 DRW */
+#define CHIP8_VARIANT_XOCHIP 2 /* SCHIP plus 64KB and a second bitplane */
+
+#ifndef CHIP8_VARIANT
+#define CHIP8_VARIANT CHIP8_VARIANT_CHIP8
+#endif
+
+#if CHIP8_VARIANT == CHIP8_VARIANT_CHIP8
+#define CHIP8_VARIANT_NAME "chip8"
 #define DISPLAY_WIDTH 64
 #define DISPLAY_HEIGHT 32
+#define DISPLAY_PLANES 1
+#define RAM_SIZE 4096
+#elif CHIP8_VARIANT == CHIP8_VARIANT_SCHIP
+#define CHIP8_VARIANT_NAME "schip"
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_PLANES 1
+#define RAM_SIZE 4096
+#elif CHIP8_VARIANT == CHIP8_VARIANT_XOCHIP
+#define CHIP8_VARIANT_NAME "xochip"
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_PLANES 2
+#define RAM_SIZE 65536
+#else
+#error "Unknown CHIP8_VARIANT"
+#endif
+
 #define DISPLAY_SIZE DISPLAY_WIDTH * DISPLAY_HEIGHT
 
-#define RAM_SIZE 4096
+/* 64-bit words per row of a plane */
+#define DISPLAY_WORDS (DISPLAY_WIDTH / 64)
+
+/* Display pixels per side of a low resolution pixel: 64x32 programs are
+ * drawn doubled on the 128x64 display */
+#define DISPLAY_LORES_SCALE (DISPLAY_WIDTH / 64)
+
+/* Pixel x of a display row lives in bit (63 - x % 64) of word x / 64 */
+#define DISPLAY_PIXEL(row, x) (((row)[(x) / 64] >> (63 - (x) % 64)) & 1u)
+
 #define STACK_SIZE 16
 
+#define RESERVED_START 0x000
+#define RESERVED_END 0x1FF
+#define PROGRAM_START 0x200
+#define PROGRAM_END (RAM_SIZE - 1)
+
+/* Bytes a taken skip steps over from next, the address after the skip:
+ * XO-CHIP skips both words of F000 nnnn */
+#if CHIP8_VARIANT == CHIP8_VARIANT_XOCHIP
+#define CHIP8_SKIP_SIZE(mem, next) \
+    ((mem)[next] == 0xF0 && (mem)[(uint16_t)((next) + 1)] == 0x00 ? 4 : 2)
+#else
+#define CHIP8_SKIP_SIZE(mem, next) 2
+#endif
+
+/* Largest ROM that fits from PROGRAM_START to the end of RAM */
+#define CHIP8_ROM_MAX (PROGRAM_END + 1 - PROGRAM_START)
+
+#define CHIP8_DEFAULT_SEED 0x853C49E6748FEA9Bu
+
+/* Save states: "C8ST", a 16-bit version, then the machine fields in a fixed
+ * little-endian layout (see chip8_save_state) */
+#define CHIP8_STATE_VERSION 2
+#define CHIP8_STATE_SIZE \
+    (8 + 11 + STACK_SIZE * 2 + 16 + 16 + 8 \
+     + DISPLAY_PLANES * DISPLAY_HEIGHT * DISPLAY_WORDS * 8 + RAM_SIZE)
+
+/* Interpreter dispatch, chosen at build time with -DCHIP8_DISPATCH=n */
+#define CHIP8_DISPATCH_TABLE 0     /* Nibble table + second-level switch */
+#define CHIP8_DISPATCH_PREDECODE 1 /* Flat table of all 64K decoded opcodes */
+#define CHIP8_DISPATCH_GOTO 2      /* Predecoded, computed-goto threaded loop */
+
+#ifndef CHIP8_DISPATCH
+#define CHIP8_DISPATCH CHIP8_DISPATCH_TABLE
+#endif
+
+/* -DCHIP8_PROFILE=1 counts every interpreted instruction, see profile.h */
+#ifndef CHIP8_PROFILE
+#define CHIP8_PROFILE 0
+#endif
+
+/* -DCHIP8_SAFE=1 builds the checked core: memory and key indices are masked
+ * to the machine's address and key widths, and a stack overflow or underflow
+ * or an invalid opcode stops the machine with a fault instead of writing
+ * outside the context. The default core trusts the ROM. */
+#ifndef CHIP8_SAFE
+#define CHIP8_SAFE 0
+#endif
+
+/* Instruction flags */
+#define CHIP8_OPF_BRANCH 0x1 /* May set pc to something other than pc + 2 */
+#define CHIP8_OPF_WRITE 0x2  /* Writes to mem */
+
+/* Quirks: behaviours the CHIP-8 variants disagree on */
+#define CHIP8_QUIRK_VF_RESET 0x01     /* 8xy1/8xy2/8xy3 clear VF */
+#define CHIP8_QUIRK_SHIFT_VY 0x02     /* 8xy6/8xyE shift Vy into Vx */
+#define CHIP8_QUIRK_LOAD_STORE_I 0x04 /* Fx55/Fx65 leave I past the block */
+#define CHIP8_QUIRK_JUMP_VX 0x08      /* Bnnn is Bxnn, jumping to xnn + Vx */
+#define CHIP8_QUIRK_CLIP 0x10         /* Sprites clip at the screen edges */
+
+/* X(name, quirks) for every quirk profile, in enum chip8_quirks order. Each
+ * gets its own interpreter with the quirks fixed at compile time. none is
+ * this core's behaviour from before profiles existed. */
+#define CHIP8_QUIRK_PROFILES(X) \
+    X(none, 0) \
+    X(chip8, CHIP8_QUIRK_VF_RESET | CHIP8_QUIRK_SHIFT_VY \
+             | CHIP8_QUIRK_LOAD_STORE_I | CHIP8_QUIRK_CLIP) \
+    X(schip, CHIP8_QUIRK_JUMP_VX | CHIP8_QUIRK_CLIP) \
+    X(xochip, CHIP8_QUIRK_SHIFT_VY | CHIP8_QUIRK_LOAD_STORE_I)
+
+/* X(name, mnemonic, flags) for every instruction, in enum chip8_op order.
+ * 00Cn-00FF and Dxy0 sprites are decoded from SCHIP up, 00Dn, F000 and
+ * Fx01 only for XO-CHIP; F000 is followed by its 16-bit address, so it is
+ * a branch as far as pc is concerned. */
+#define CHIP8_OPS(X) \
+    X(invalid, "???", 0) \
+    X(0nnn, "SYS addr", 0) \
+    X(00E0, "CLS", 0) \
+    X(00EE, "RET", CHIP8_OPF_BRANCH) \
+    X(00Cn, "SCD nibble", 0) \
+    X(00Dn, "SCU nibble", 0) \
+    X(00FB, "SCR", 0) \
+    X(00FC, "SCL", 0) \
+    X(00FD, "EXIT", CHIP8_OPF_BRANCH) \
+    X(00FE, "LOW", 0) \
+    X(00FF, "HIGH", 0) \
+    X(1nnn, "JP addr", CHIP8_OPF_BRANCH) \
+    X(2nnn, "CALL addr", CHIP8_OPF_BRANCH) \
+    X(3xkk, "SE Vx, byte", CHIP8_OPF_BRANCH) \
+    X(4xkk, "SNE Vx, byte", CHIP8_OPF_BRANCH) \
+    X(5xy0, "SE Vx, Vy", CHIP8_OPF_BRANCH) \
+    X(6xkk, "LD Vx, byte", 0) \
+    X(7xkk, "ADD Vx, byte", 0) \
+    X(8xy0, "LD Vx, Vy", 0) \
+    X(8xy1, "OR Vx, Vy", 0) \
+    X(8xy2, "AND Vx, Vy", 0) \
+    X(8xy3, "XOR Vx, Vy", 0) \
+    X(8xy4, "ADD Vx, Vy", 0) \
+    X(8xy5, "SUB Vx, Vy", 0) \
+    X(8xy6, "SHR Vx {, Vy}", 0) \
+    X(8xy7, "SUBN Vx, Vy", 0) \
+    X(8xyE, "SHL Vx {, Vy}", 0) \
+    X(9xy0, "SNE Vx, Vy", CHIP8_OPF_BRANCH) \
+    X(Annn, "LD I, addr", 0) \
+    X(Bnnn, "JP V0, addr", CHIP8_OPF_BRANCH) \
+    X(Cxkk, "RND Vx, byte", 0) \
+    X(Dxyn, "DRW Vx, Vy, nibble", 0) \
+    X(Ex9E, "SKP Vx", CHIP8_OPF_BRANCH) \
+    X(ExA1, "SKNP Vx", CHIP8_OPF_BRANCH) \
+    X(F000, "LD I, long", CHIP8_OPF_BRANCH) \
+    X(Fx01, "PLANE mask", 0) \
+    X(Fx07, "LD Vx, DT", 0) \
+    X(Fx0A, "LD Vx, K", CHIP8_OPF_BRANCH) \
+    X(Fx15, "LD DT, Vx", 0) \
+    X(Fx18, "LD ST, Vx", 0) \
+    X(Fx1E, "ADD I, Vx", 0) \
+    X(Fx29, "LD F, Vx", 0) \
+    X(Fx33, "LD B, Vx", CHIP8_OPF_WRITE) \
+    X(Fx55, "LD [I], Vx", CHIP8_OPF_WRITE) \
+    X(Fx65, "LD Vx, [I]", 0)
+
+/* Result of loading a ROM */
+enum chip8_rom_status {
+    CHIP8_ROM_OK,
+    CHIP8_ROM_OPEN_FAILED,
+    CHIP8_ROM_READ_FAILED,
+    CHIP8_ROM_EMPTY,
+    CHIP8_ROM_TOO_LARGE
+};
+
+/* Why a CHIP8_SAFE core stopped; always CHIP8_FAULT_NONE otherwise */
+enum chip8_fault_type {
+    CHIP8_FAULT_NONE,
+    CHIP8_FAULT_STACK_OVERFLOW,
+    CHIP8_FAULT_STACK_UNDERFLOW,
+    CHIP8_FAULT_INVALID_OPCODE
+};
+
+enum chip8_quirks {
+#define CHIP8_QUIRKS_ENUM(name, quirks) CHIP8_QUIRKS_##name,
+    CHIP8_QUIRK_PROFILES(CHIP8_QUIRKS_ENUM)
+#undef CHIP8_QUIRKS_ENUM
+    CHIP8_QUIRKS_COUNT
+};
+
+enum chip8_op {
+#define CHIP8_OP_ENUM(name, mnemonic, flags) CHIP8_OP_##name,
+    CHIP8_OPS(CHIP8_OP_ENUM)
+#undef CHIP8_OP_ENUM
+    CHIP8_OP_COUNT
+};
+
+/* An opcode split into its operand fields; n is the low nibble of kk */
+struct chip8_insn {
+    uint16_t opcode;
+    uint16_t nnn;
+    uint8_t op;
+    uint8_t x;
+    uint8_t y;
+    uint8_t kk;
+};
+
+/* The instruction that stopped the machine; pc is left pointing at it */
+struct chip8_fault {
+    uint8_t type;
+    uint16_t pc;
+    uint16_t opcode;
+};
+
+/* Execution counts, filled in when the context has one attached */
+struct chip8_profile {
+    uint64_t cycles;
+    uint64_t op_counts[CHIP8_OP_COUNT];
+    uint64_t pc_counts[RAM_SIZE];
+};
+
 struct chip8_context {
-    void (*opcode_table[0xF + 1])(struct chip8_context *);
+    /* Everything up to keys is restored from a template by chip8_reset */
 
-    uint32_t display[DISPLAY_SIZE];
+    /* 1bpp per plane, DISPLAY_WORDS 64-bit words per row */
+    uint64_t display[DISPLAY_PLANES][DISPLAY_HEIGHT][DISPLAY_WORDS];
+
+    /* RND state, see chip8_seed */
+    uint64_t rng;
 
     uint16_t i;
     uint16_t pc;
@@ -18,16 +240,81 @@ struct chip8_context {
 
     uint16_t opcode;
 
-    uint8_t mem[RAM_SIZE];
     uint8_t registers[16];
     uint8_t sp;
 
     uint8_t delay_timer;
     uint8_t sound_timer;
 
+    /* 128x64 mode (00FF); in low resolution every pixel is drawn as a
+     * DISPLAY_LORES_SCALE square */
+    uint8_t hires;
+
+    /* Bit p set when DRW, CLS and the scrolls act on plane p (Fx01) */
+    uint8_t planes;
+
+    /* Kept by chip8_reset */
     uint8_t keys[0xF + 1];
+
+    /* Bumped on every display write; the dirty rectangle accumulates the
+     * touched pixels until chip8_display_clean is called */
+    uint8_t dirty_left;
+    uint8_t dirty_top;
+    uint8_t dirty_right;
+    uint8_t dirty_bottom;
+    uint32_t display_gen;
+
+    /* Bit k set when an instruction tests key k; only ever set here, the
+     * frontend clears it when it has looked */
+    uint16_t keys_read;
+
+    /* enum chip8_quirks; kept by chip8_reset, set after loading a ROM */
+    uint8_t quirks;
+
+    /* Last value given to chip8_seed */
+    uint64_t seed;
+
+    /* Last so that a reset only rewrites the start of it */
+    uint8_t mem[RAM_SIZE];
+
+#if CHIP8_PROFILE
+    struct chip8_profile *profile;
+#endif
+
+#if CHIP8_SAFE
+    /* Sticky until chip8_reset or chip8_load_state */
+    struct chip8_fault fault;
+#endif
 };
 
 int chip8_init(struct chip8_context *ctx);
-void chip8_loadrom(struct chip8_context *ctx, const char *filepath);
-void chip8_cycle(struct chip8_context *ctx);
+void chip8_reset(struct chip8_context *ctx);
+void chip8_clone(struct chip8_context *dst, const struct chip8_context *src);
+int chip8_loadrom(struct chip8_context *ctx, const char *filepath);
+int chip8_loadrom_mem(struct chip8_context *ctx, const uint8_t *rom,
+                      size_t size);
+const char *chip8_rom_status_string(int status);
+const char *chip8_fault_string(int type);
+uint64_t chip8_hash(const void *data, size_t size);
+uint64_t chip8_program_hash(const struct chip8_context *ctx);
+size_t chip8_sprite_size(const struct chip8_context *ctx, uint8_t n);
+int chip8_cycle(struct chip8_context *ctx);
+int chip8_run(struct chip8_context *ctx, uint32_t cycles);
+int chip8_exec(struct chip8_context *ctx, const struct chip8_insn *insn);
+void chip8_seed(struct chip8_context *ctx, uint64_t seed);
+void chip8_tick_timers(struct chip8_context *ctx);
+int chip8_frame(struct chip8_context *ctx, uint32_t cycles);
+void chip8_display_clean(struct chip8_context *ctx);
+size_t chip8_save_state(const struct chip8_context *ctx, uint8_t *buf,
+                        size_t size);
+int chip8_load_state(struct chip8_context *ctx, const uint8_t *buf,
+                     size_t size);
+void chip8_decode(uint16_t opcode, struct chip8_insn *insn);
+uint8_t chip8_op_flags(uint8_t op);
+uint8_t chip8_quirk_flags(int quirks);
+const char *chip8_quirks_name(int quirks);
+int chip8_quirks_parse(const char *name);
+const char *chip8_op_mnemonic(uint8_t op);
+void chip8_disasm(const struct chip8_insn *insn, char *buf, size_t size);
+
+#endif
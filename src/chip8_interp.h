@@ -0,0 +1,831 @@
+/* Interpreter template: the instruction handlers and run loops, included
+ * by chip8.c once per quirk profile with QUIRKS defined as the profile's
+ * name from CHIP8_QUIRK_PROFILES. Everything here is static and named with
+ * the profile as a suffix (op_8xy6_chip8, run_chip8, ...), and QUIRK(bit)
+ * is a constant, so each copy is compiled with its quirks already decided.
+ * No include guard, on purpose. */
+
+#define INTERP_PASTE2(a, b) a##_##b
+#define INTERP_PASTE(a, b) INTERP_PASTE2(a, b)
+#define Q(name) INTERP_PASTE(name, QUIRKS)
+#define QUIRK(bit) \
+    ((INTERP_PASTE(QUIRK_FLAGS, QUIRKS) & CHIP8_QUIRK_##bit) != 0)
+
+static int Q(cycle)(struct chip8_context *ctx);
+static int Q(run)(struct chip8_context *ctx, uint32_t cycles);
+static int Q(exec)(struct chip8_context *ctx, const struct chip8_insn *insn);
+
+#define OP_PROTOTYPE(name, mnemonic, flags) \
+    static void Q(op_##name)(struct chip8_context *ctx, \
+                             const struct chip8_insn *in);
+CHIP8_OPS(OP_PROTOTYPE)
+#undef OP_PROTOTYPE
+
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_TABLE
+/* Second-level decode of the groups sharing a top nibble; the other
+ * dispatch modes decode the whole opcode up front instead */
+static void Q(op_0_decode)(struct chip8_context *ctx,
+                           const struct chip8_insn *in);
+static void Q(op_8_decode)(struct chip8_context *ctx,
+                           const struct chip8_insn *in);
+static void Q(op_E_decode)(struct chip8_context *ctx,
+                           const struct chip8_insn *in);
+static void Q(op_F_decode)(struct chip8_context *ctx,
+                           const struct chip8_insn *in);
+
+/* First level of CHIP8_DISPATCH_TABLE, indexed by the top nibble */
+static void (*const Q(opcode_table)[0xF + 1])(struct chip8_context *ctx,
+                                              const struct chip8_insn *in) = {
+    &Q(op_0_decode), &Q(op_1nnn), &Q(op_2nnn), &Q(op_3xkk),
+    &Q(op_4xkk), &Q(op_5xy0), &Q(op_6xkk), &Q(op_7xkk),
+    &Q(op_8_decode), &Q(op_9xy0), &Q(op_Annn), &Q(op_Bnnn),
+    &Q(op_Cxkk), &Q(op_Dxyn), &Q(op_E_decode), &Q(op_F_decode)
+};
+#endif
+
+/* Handlers indexed by enum chip8_op */
+static void (*const Q(op_table)[CHIP8_OP_COUNT])(
+    struct chip8_context *ctx, const struct chip8_insn *in) = {
+#define OP_TABLE_ENTRY(name, mnemonic, flags) &Q(op_##name),
+    CHIP8_OPS(OP_TABLE_ENTRY)
+#undef OP_TABLE_ENTRY
+};
+
+static int Q(cycle)(struct chip8_context *ctx)
+{
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_TABLE
+    if (ctx->pc < PROGRAM_END && FAULT_TYPE(ctx) == CHIP8_FAULT_NONE) {
+        struct chip8_insn in;
+
+        ctx->opcode = (ctx->mem[ctx->pc] << 8u) | ctx->mem[ctx->pc + 1];
+
+        /* printf("[%03x] %04x\n", ctx->pc, ctx->opcode); */
+
+        PROFILE_HIT(ctx, ctx->pc, decode_op(ctx->opcode));
+        ctx->pc += 2;
+
+        if (ctx->opcode) {
+            /* Split the operands once for the handler */
+            in.opcode = ctx->opcode;
+            in.nnn = ctx->opcode & 0x0FFFu;
+            in.x = (ctx->opcode & 0x0F00u) >> 8u;
+            in.y = (ctx->opcode & 0x00F0u) >> 4u;
+            in.kk = ctx->opcode & 0x00FFu;
+
+            Q(opcode_table)[ctx->opcode >> 12u](ctx, &in);
+        }
+    }
+
+    return FAULT_TYPE(ctx);
+#else
+    return Q(run)(ctx, 1);
+#endif
+}
+
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_GOTO
+static int Q(run)(struct chip8_context *ctx, uint32_t cycles)
+{
+    static const void *const labels[CHIP8_OP_COUNT] = {
+#define OP_LABEL(name, mnemonic, flags) &&do_##name,
+        CHIP8_OPS(OP_LABEL)
+#undef OP_LABEL
+    };
+    const struct chip8_insn *in;
+
+    /* Each handler jumps straight to the next one */
+#define DISPATCH() \
+    do { \
+        if (cycles-- == 0 || ctx->pc >= PROGRAM_END \
+            || FAULT_TYPE(ctx) != CHIP8_FAULT_NONE) { \
+            return FAULT_TYPE(ctx); \
+        } \
+        in = &decode_table[(ctx->mem[ctx->pc] << 8u) | ctx->mem[ctx->pc + 1]]; \
+        ctx->opcode = in->opcode; \
+        PROFILE_HIT(ctx, ctx->pc, in->op); \
+        ctx->pc += 2; \
+        goto *labels[in->op]; \
+    } while (0)
+
+    DISPATCH();
+
+#define OP_CASE(name, mnemonic, flags) \
+    do_##name: \
+        Q(op_##name)(ctx, in); \
+        DISPATCH();
+    CHIP8_OPS(OP_CASE)
+#undef OP_CASE
+#undef DISPATCH
+}
+#else
+static int Q(run)(struct chip8_context *ctx, uint32_t cycles)
+{
+    for (uint32_t c = 0; c < cycles && ctx->pc < PROGRAM_END
+                         && FAULT_TYPE(ctx) == CHIP8_FAULT_NONE; ++c) {
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_PREDECODE
+        const struct chip8_insn *in = &decode_table[(ctx->mem[ctx->pc] << 8u)
+                                                    | ctx->mem[ctx->pc + 1]];
+
+        ctx->opcode = in->opcode;
+        PROFILE_HIT(ctx, ctx->pc, in->op);
+        ctx->pc += 2;
+        Q(op_table)[in->op](ctx, in);
+#else
+        Q(cycle)(ctx);
+#endif
+    }
+
+    return FAULT_TYPE(ctx);
+}
+#endif
+
+static int Q(exec)(struct chip8_context *ctx, const struct chip8_insn *insn)
+{
+    if (ctx->pc < PROGRAM_END && FAULT_TYPE(ctx) == CHIP8_FAULT_NONE) {
+        ctx->opcode = insn->opcode;
+        PROFILE_HIT(ctx, ctx->pc, insn->op);
+        ctx->pc += 2;
+        Q(op_table)[insn->op](ctx, insn);
+    }
+
+    return FAULT_TYPE(ctx);
+}
+
+static void Q(op_invalid)(struct chip8_context *ctx,
+                          const struct chip8_insn *in)
+{
+    FAULT_CHECK(ctx, 1, CHIP8_FAULT_INVALID_OPCODE);
+    printf("Unhandled instruction.\n");
+}
+
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_TABLE
+static void Q(op_0_decode)(struct chip8_context *ctx,
+                           const struct chip8_insn *in)
+{
+    switch (in->kk) {
+    case 0xE0:
+        Q(op_00E0)(ctx, in);
+        break;
+
+    case 0xEE:
+        Q(op_00EE)(ctx, in);
+        break;
+
+#if CHIP8_VARIANT != CHIP8_VARIANT_CHIP8
+    case 0xFB:
+        Q(op_00FB)(ctx, in);
+        break;
+
+    case 0xFC:
+        Q(op_00FC)(ctx, in);
+        break;
+
+    case 0xFD:
+        Q(op_00FD)(ctx, in);
+        break;
+
+    case 0xFE:
+        Q(op_00FE)(ctx, in);
+        break;
+
+    case 0xFF:
+        Q(op_00FF)(ctx, in);
+        break;
+#endif
+
+    default:
+#if CHIP8_VARIANT != CHIP8_VARIANT_CHIP8
+        if ((in->kk & 0xF0u) == 0xC0u) {
+            Q(op_00Cn)(ctx, in);
+            break;
+        }
+#endif
+
+#if CHIP8_VARIANT == CHIP8_VARIANT_XOCHIP
+        if ((in->kk & 0xF0u) == 0xD0u) {
+            Q(op_00Dn)(ctx, in);
+            break;
+        }
+#endif
+
+        Q(op_invalid)(ctx, in);
+    }
+}
+#endif
+
+static void Q(op_0nnn)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SYS addr */
+}
+
+static void Q(op_00E0)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* CLS */
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        if (ctx->planes & (1u << plane)) {
+            memset(ctx->display[plane], 0, sizeof(ctx->display[plane]));
+        }
+    }
+
+    display_touch(ctx, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+}
+
+static void Q(op_00EE)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* RET */
+    FAULT_CHECK(ctx, ctx->sp == 0, CHIP8_FAULT_STACK_UNDERFLOW);
+    ctx->pc = ctx->stack[--ctx->sp];
+}
+
+static void Q(op_00Cn)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SCD nibble; distances are in pixels of the current resolution */
+    int scale = ctx->hires ? 1 : DISPLAY_LORES_SCALE;
+
+    display_scroll(ctx, (in->kk & 0x0Fu) * scale, 0);
+}
+
+static void Q(op_00Dn)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SCU nibble */
+    int scale = ctx->hires ? 1 : DISPLAY_LORES_SCALE;
+
+    display_scroll(ctx, -(int)(in->kk & 0x0Fu) * scale, 0);
+}
+
+static void Q(op_00FB)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SCR */
+    int scale = ctx->hires ? 1 : DISPLAY_LORES_SCALE;
+
+    display_scroll(ctx, 0, 4 * scale);
+}
+
+static void Q(op_00FC)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SCL */
+    int scale = ctx->hires ? 1 : DISPLAY_LORES_SCALE;
+
+    display_scroll(ctx, 0, -4 * scale);
+}
+
+static void Q(op_00FD)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* EXIT; there is nothing to exit to, so the machine stays here */
+    ctx->pc -= 2;
+}
+
+static void Q(op_00FE)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LOW; switching resolution clears every plane */
+    ctx->hires = 0;
+    memset(ctx->display, 0, sizeof(ctx->display));
+    display_touch(ctx, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+}
+
+static void Q(op_00FF)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* HIGH */
+    ctx->hires = 1;
+    memset(ctx->display, 0, sizeof(ctx->display));
+    display_touch(ctx, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+}
+
+static void Q(op_1nnn)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* JP addr */
+    ctx->pc = in->nnn;
+}
+
+static void Q(op_2nnn)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* CALL addr */
+    FAULT_CHECK(ctx, ctx->sp >= STACK_SIZE, CHIP8_FAULT_STACK_OVERFLOW);
+    ctx->stack[ctx->sp++] = ctx->pc;
+    ctx->pc = in->nnn;
+}
+
+static void Q(op_3xkk)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SE Vx, byte */
+    uint8_t x = in->x;
+    uint8_t byte = in->kk;
+
+    if (ctx->registers[x] == byte) {
+        ctx->pc += CHIP8_SKIP_SIZE(ctx->mem, ctx->pc);
+    }
+}
+
+static void Q(op_4xkk)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SNE Vx, byte */
+    uint8_t x = in->x;
+    uint8_t byte = in->kk;
+
+    if (ctx->registers[x] != byte) {
+        ctx->pc += CHIP8_SKIP_SIZE(ctx->mem, ctx->pc);
+    }
+}
+
+static void Q(op_5xy0)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SE Vx, Vy */
+    uint8_t x = in->x;
+    uint8_t y = in->y;
+
+    if (ctx->registers[x] == ctx->registers[y]) {
+        ctx->pc += CHIP8_SKIP_SIZE(ctx->mem, ctx->pc);
+    }
+}
+
+static void Q(op_6xkk)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD Vx, byte */
+    uint8_t x = in->x;
+
+    ctx->registers[x] = in->kk;
+}
+
+static void Q(op_7xkk)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* ADD Vx, byte */
+    uint8_t x = in->x;
+
+    ctx->registers[x] += in->kk;
+}
+
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_TABLE
+static void Q(op_8_decode)(struct chip8_context *ctx,
+                           const struct chip8_insn *in)
+{
+    switch (in->kk & 0x0Fu) {
+    case 0x0:
+        Q(op_8xy0)(ctx, in);
+        break;
+
+    case 0x1:
+        Q(op_8xy1)(ctx, in);
+        break;
+
+    case 0x2:
+        Q(op_8xy2)(ctx, in);
+        break;
+
+    case 0x3:
+        Q(op_8xy3)(ctx, in);
+        break;
+
+    case 0x4:
+        Q(op_8xy4)(ctx, in);
+        break;
+
+    case 0x5:
+        Q(op_8xy5)(ctx, in);
+        break;
+
+    case 0x6:
+        Q(op_8xy6)(ctx, in);
+        break;
+
+    case 0x7:
+        Q(op_8xy7)(ctx, in);
+        break;
+
+    case 0xE:
+        Q(op_8xyE)(ctx, in);
+        break;
+
+    default:
+        Q(op_invalid)(ctx, in);
+        break;
+    }
+}
+#endif
+
+static void Q(op_8xy0)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD Vx, Vy */
+    uint8_t x = in->x;
+    uint8_t y = in->y;
+
+    ctx->registers[x] = ctx->registers[y];
+}
+
+static void Q(op_8xy1)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* OR Vx, Vy */
+    uint8_t x = in->x;
+    uint8_t y = in->y;
+
+    ctx->registers[x] |= ctx->registers[y];
+
+    if (QUIRK(VF_RESET)) {
+        ctx->registers[0xF] = 0;
+    }
+}
+
+static void Q(op_8xy2)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* AND Vx, Vy */
+    uint8_t x = in->x;
+    uint8_t y = in->y;
+
+    ctx->registers[x] &= ctx->registers[y];
+
+    if (QUIRK(VF_RESET)) {
+        ctx->registers[0xF] = 0;
+    }
+}
+
+static void Q(op_8xy3)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* XOR Vx, Vy */
+    uint8_t x = in->x;
+    uint8_t y = in->y;
+
+    ctx->registers[x] ^= ctx->registers[y];
+
+    if (QUIRK(VF_RESET)) {
+        ctx->registers[0xF] = 0;
+    }
+}
+
+static void Q(op_8xy4)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* ADD Vx, Vy */
+    uint8_t x = in->x;
+    uint8_t y = in->y;
+    uint16_t res = ctx->registers[x] + ctx->registers[y];
+
+    ctx->registers[0xF] = res > 255 ? 1 : 0;
+    ctx->registers[x] = res & 0x00FFu;
+}
+
+static void Q(op_8xy5)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SUB Vx, Vy */
+    uint8_t x = in->x;
+    uint8_t y = in->y;
+
+    ctx->registers[0xF] = x > y ? 1 : 0;
+    ctx->registers[x] -= ctx->registers[y];
+}
+
+static void Q(op_8xy6)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SHR Vx, {, Vy} */
+    uint8_t x = in->x;
+
+    if (QUIRK(SHIFT_VY)) {
+        ctx->registers[x] = ctx->registers[in->y];
+    }
+
+    ctx->registers[0xF] = ctx->registers[x] & 0x1 ? 1 : 0;
+    ctx->registers[x] >>= 1;
+}
+
+static void Q(op_8xy7)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SUBN Vx, Vy */
+    uint8_t x = in->x;
+    uint8_t y = in->y;
+
+    ctx->registers[0xF] = ctx->registers[y] > ctx->registers[x] ? 1 : 0;
+    ctx->registers[x] = ctx->registers[y] - ctx->registers[x];
+}
+
+static void Q(op_8xyE)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SHL Vx, {, Vy} */
+    uint8_t x = in->x;
+
+    if (QUIRK(SHIFT_VY)) {
+        ctx->registers[x] = ctx->registers[in->y];
+    }
+
+    ctx->registers[0xF] = ctx->registers[x] & 128u ? 1 : 0;
+    ctx->registers[x] <<= 1;
+}
+
+static void Q(op_9xy0)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SNE Vx, Vy */
+    uint8_t x = in->x;
+    uint8_t y = in->y;
+
+    if (ctx->registers[x] != ctx->registers[y]) {
+        ctx->pc += CHIP8_SKIP_SIZE(ctx->mem, ctx->pc);
+    }
+}
+
+static void Q(op_Annn)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD I, addr */
+    ctx->i = in->nnn;
+}
+
+static void Q(op_Bnnn)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* JP V0, addr; JP Vx, xnn with the jump quirk */
+    uint8_t x = QUIRK(JUMP_VX) ? in->x : 0x0;
+
+    ctx->pc = MEM_ADDR((in->nnn) + ctx->registers[x]);
+}
+
+static void Q(op_Cxkk)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* RND Vx, byte */
+    uint8_t x = in->x;
+
+    ctx->registers[x] = (uint8_t)(rng_next(ctx) >> 24) & in->kk;
+}
+
+static void Q(op_Dxyn)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* DRW Vx, Vy, nibble; Dxy0 is a 16x16 sprite from SCHIP up */
+    uint8_t n = in->kk & 0x0Fu;
+    unsigned scale = ctx->hires ? 1 : DISPLAY_LORES_SCALE;
+    unsigned width = 8;
+    unsigned height = n;
+    unsigned x_origin;
+    unsigned y_origin;
+    uint16_t addr = ctx->i;
+    uint64_t collision = 0;
+
+#if CHIP8_VARIANT != CHIP8_VARIANT_CHIP8
+    if (n == 0) {
+        width = 16;
+        height = 16;
+    }
+#endif
+
+    x_origin = ctx->registers[in->x] % (DISPLAY_WIDTH / scale) * scale;
+    y_origin = ctx->registers[in->y] % (DISPLAY_HEIGHT / scale) * scale;
+
+    /* Sprites wrap around both edges of the screen, or are cut off by them
+     * with the clip quirk. Each selected plane has its own sprite, one
+     * after the other from I. */
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        if (!(ctx->planes & (1u << plane))) {
+            continue;
+        }
+
+        for (unsigned row = 0; row < height; ++row) {
+            uint16_t at = addr + row * (width / 8);
+            uint64_t bits = ctx->mem[MEM_ADDR(at)];
+            unsigned y = y_origin + row * scale;
+
+            if (QUIRK(CLIP) && y >= DISPLAY_HEIGHT) {
+                break;
+            }
+
+            if (width == 16) {
+                bits = bits << 8 | ctx->mem[MEM_ADDR((uint16_t)(at + 1))];
+            }
+
+            if (scale > 1) {
+                bits = display_double(bits);
+            }
+
+            bits <<= 64 - width * scale;
+
+            collision |= display_draw_row(
+                ctx->display[plane][y % DISPLAY_HEIGHT], bits, x_origin,
+                QUIRK(CLIP));
+
+            /* Low resolution rows are drawn twice; y is even, so the
+             * second row is on screen whenever the first is */
+            if (scale > 1) {
+                collision |= display_draw_row(
+                    ctx->display[plane][(y + 1) % DISPLAY_HEIGHT], bits,
+                    x_origin, QUIRK(CLIP));
+            }
+        }
+
+        addr += height * (width / 8);
+    }
+
+    ctx->registers[0xF] = collision ? 1 : 0;
+
+    if (height > 0) {
+        /* display_touch clips the rectangle itself */
+        unsigned right = x_origin + width * scale;
+        unsigned bottom = y_origin + height * scale;
+        int wraps_x = !QUIRK(CLIP) && right > DISPLAY_WIDTH;
+        int wraps_y = !QUIRK(CLIP) && bottom > DISPLAY_HEIGHT;
+
+        display_touch(ctx,
+                      wraps_x ? 0 : x_origin,
+                      wraps_y ? 0 : y_origin,
+                      wraps_x ? DISPLAY_WIDTH : right,
+                      wraps_y ? DISPLAY_HEIGHT : bottom);
+    }
+}
+
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_TABLE
+static void Q(op_E_decode)(struct chip8_context *ctx,
+                           const struct chip8_insn *in)
+{
+    switch (in->kk) {
+    case 0x9E:
+        Q(op_Ex9E)(ctx, in);
+        break;
+
+    case 0xA1:
+        Q(op_ExA1)(ctx, in);
+        break;
+
+    default:
+        Q(op_invalid)(ctx, in);
+        break;
+    }
+}
+#endif
+
+static void Q(op_Ex9E)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SKP Vx */
+    uint8_t x = in->x;
+
+    ctx->keys_read |= 1u << (ctx->registers[x] & 0xF);
+
+    if (ctx->keys[KEY_INDEX(ctx->registers[x])]) {
+        ctx->pc += CHIP8_SKIP_SIZE(ctx->mem, ctx->pc);
+    }
+}
+
+static void Q(op_ExA1)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* SKNP Vx */
+    uint8_t x = in->x;
+
+    ctx->keys_read |= 1u << (ctx->registers[x] & 0xF);
+
+    if (!ctx->keys[KEY_INDEX(ctx->registers[x])]) {
+        ctx->pc += CHIP8_SKIP_SIZE(ctx->mem, ctx->pc);
+    }
+}
+
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_TABLE
+static void Q(op_F_decode)(struct chip8_context *ctx,
+                           const struct chip8_insn *in)
+{
+    switch (in->kk) {
+#if CHIP8_VARIANT == CHIP8_VARIANT_XOCHIP
+    case 0x00:
+        if (in->x == 0) {
+            Q(op_F000)(ctx, in);
+        } else {
+            Q(op_invalid)(ctx, in);
+        }
+        break;
+
+    case 0x01:
+        Q(op_Fx01)(ctx, in);
+        break;
+#endif
+
+    case 0x07:
+        Q(op_Fx07)(ctx, in);
+        break;
+
+    case 0x0A:
+        Q(op_Fx0A)(ctx, in);
+        break;
+
+    case 0x15:
+        Q(op_Fx15)(ctx, in);
+        break;
+
+    case 0x18:
+        Q(op_Fx18)(ctx, in);
+        break;
+
+    case 0x1E:
+        Q(op_Fx1E)(ctx, in);
+        break;
+
+    case 0x29:
+        Q(op_Fx29)(ctx, in);
+        break;
+
+    case 0x33:
+        Q(op_Fx33)(ctx, in);
+        break;
+
+    case 0x55:
+        Q(op_Fx55)(ctx, in);
+        break;
+
+    case 0x65:
+        Q(op_Fx65)(ctx, in);
+        break;
+
+    default:
+        Q(op_invalid)(ctx, in);
+        break;
+    }
+}
+#endif
+
+static void Q(op_F000)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD I, long; the address is the word after the opcode */
+    ctx->i = (ctx->mem[MEM_ADDR(ctx->pc)] << 8u)
+             | ctx->mem[MEM_ADDR((uint16_t)(ctx->pc + 1))];
+    ctx->pc += 2;
+}
+
+static void Q(op_Fx01)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* PLANE mask */
+    ctx->planes = in->x & ((1u << DISPLAY_PLANES) - 1);
+}
+
+static void Q(op_Fx07)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD Vx, DT */
+    uint8_t x = in->x;
+    ctx->registers[x] = ctx->delay_timer;
+}
+
+static void Q(op_Fx0A)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD Vx, K */
+    uint8_t x = in->x;
+
+    for (int i = 0; i < 0xF + 1; ++i) {
+        if (ctx->keys[i]) {
+            /* Keys past the first one down weren't looked at */
+            ctx->keys_read |= (2u << i) - 1;
+            ctx->registers[x] = i;
+            return;
+        }
+    }
+
+    ctx->keys_read = 0xFFFF;
+    ctx->pc -= 2;
+}
+
+static void Q(op_Fx15)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD DT, Vx */
+    uint8_t x = in->x;
+    ctx->delay_timer = ctx->registers[x];
+}
+
+static void Q(op_Fx18)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD ST, Vx */
+    uint8_t x = in->x;
+    ctx->sound_timer = ctx->registers[x];
+}
+
+static void Q(op_Fx1E)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* ADD I, Vx */
+    uint8_t x = in->x;
+    ctx->i += ctx->registers[x];
+}
+
+static void Q(op_Fx29)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* TODO drawing */
+}
+
+static void Q(op_Fx33)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* TODO drawing */
+}
+
+static void Q(op_Fx55)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD [I], Vx */
+    uint8_t x = in->x;
+
+    for (uint8_t j = 0; j <= x; ++j) {
+        ctx->mem[MEM_ADDR(ctx->i + j)] = ctx->registers[j];
+    }
+
+    if (QUIRK(LOAD_STORE_I)) {
+        ctx->i += x + 1;
+    }
+}
+
+static void Q(op_Fx65)(struct chip8_context *ctx, const struct chip8_insn *in)
+{
+    /* LD Vx, [I] */
+    uint8_t x = in->x;
+
+    for (uint8_t j = 0; j <= x; ++j) {
+        ctx->registers[j] = ctx->mem[MEM_ADDR(ctx->i + j)];
+    }
+
+    if (QUIRK(LOAD_STORE_I)) {
+        ctx->i += x + 1;
+    }
+}
+
+#undef QUIRK
+#undef Q
+#undef INTERP_PASTE
+#undef INTERP_PASTE2
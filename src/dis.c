@@ -0,0 +1,795 @@
+#include "chip8.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Static ROM analyser. Code is found by recursive descent from
+ * PROGRAM_START: each instruction reached is decoded with chip8_decode and
+ * its successors followed, jumps and calls to their targets and skips to
+ * both the next instruction and the one after it. Bnnn jumps through a
+ * register, so nothing past one is followed; they are listed instead, as
+ * are successors outside the ROM image.
+ *
+ * Blocks end after any branch or memory write and start wherever one of
+ * those leads, the same boundaries the block cache and the JIT find at run
+ * time. Within a block I is tracked from Annn and F000, which is enough to
+ * place most Fx55 writes and report those that land on code. Fx33 ends a
+ * block like any write, but the core doesn't implement it yet, so it
+ * writes nothing here either. Edges back to a block still on the stack of
+ * a depth-first walk of the CFG mark loop headers. Reachable instructions
+ * whose behaviour a quirk changes are counted per quirk, to show which
+ * quirks a ROM can depend on. */
+
+/* Per-address flags */
+#define DIS_CODE 0x001        /* First byte of a reachable instruction */
+#define DIS_OPERAND 0x002     /* A later byte of one */
+#define DIS_LEADER 0x004      /* Starts a block */
+#define DIS_CALLED 0x008      /* Target of a 2nnn */
+#define DIS_LOOP 0x010        /* Target of a back edge */
+#define DIS_WRITTEN 0x020     /* Written by a placed Fx55 */
+#define DIS_WRITES_CODE 0x040 /* An Fx55 that writes over code */
+#define DIS_BLIND_WRITE 0x080 /* An Fx55 with I unknown */
+#define DIS_LEAVES_ROM 0x100  /* Has a successor outside the ROM image */
+
+/* A skip's two successors, or a call's target and return site */
+#define DIS_MAX_EDGES 2
+
+/* Any byte of the image can start a block: 22 03 followed by 0x33 bytes
+ * runs skips from both even and odd addresses, making every byte a leader */
+#define DIS_MAX_BLOCKS CHIP8_ROM_MAX
+
+enum dis_edge_kind {
+    DIS_EDGE_NEXT,
+    DIS_EDGE_JUMP,
+    DIS_EDGE_CALL,
+    DIS_EDGE_SKIP
+};
+
+enum dis_visit {
+    DIS_VISIT_NEW,
+    DIS_VISIT_ACTIVE,
+    DIS_VISIT_DONE
+};
+
+struct dis_edge {
+    uint32_t to;
+    uint8_t kind;
+    uint8_t back;
+};
+
+struct dis_block {
+    uint16_t start;
+    uint16_t last;
+    uint8_t edge_count;
+    struct dis_edge edges[DIS_MAX_EDGES];
+
+    /* Depth-first walk state, see dis_find_loops */
+    uint8_t visit;
+    uint8_t next_edge;
+};
+
+struct dis_quirk {
+    uint8_t quirk;
+    const char *name;
+};
+
+static const struct dis_quirk dis_quirks[] = {
+    { CHIP8_QUIRK_VF_RESET, "vf-reset" },
+    { CHIP8_QUIRK_SHIFT_VY, "shift-vy" },
+    { CHIP8_QUIRK_LOAD_STORE_I, "load-store-i" },
+    { CHIP8_QUIRK_JUMP_VX, "jump-vx" },
+    { CHIP8_QUIRK_CLIP, "clip" }
+};
+
+#define DIS_QUIRK_COUNT (sizeof(dis_quirks) / sizeof(dis_quirks[0]))
+
+struct dis_state {
+    struct chip8_context ctx;
+    const char *path;
+    uint32_t rom_end;
+    int quirks;
+
+    uint16_t flags[RAM_SIZE];
+
+    /* I at each DIS_WRITES_CODE instruction */
+    uint16_t write_to[RAM_SIZE];
+
+    /* Block index + 1 for each block start, 0 if none */
+    uint32_t block_at[RAM_SIZE];
+    struct dis_block blocks[DIS_MAX_BLOCKS];
+    uint32_t block_count;
+
+    /* Worklist of the descent, then the stack of the depth-first walk */
+    uint32_t pending[RAM_SIZE];
+
+    uint32_t insns;
+    uint32_t subroutines;
+    uint32_t loops;
+    uint32_t indirect;
+    uint32_t invalid;
+    uint32_t exits;
+    uint32_t code_writes;
+    uint32_t blind_writes;
+    uint32_t quirk_counts[DIS_QUIRK_COUNT];
+};
+
+static int dis_load(struct dis_state *ds, const char *path);
+static int dis_in_rom(const struct dis_state *ds, uint32_t addr);
+static void dis_decode(const struct dis_state *ds, uint32_t addr,
+                       struct chip8_insn *insn);
+static uint16_t dis_long(const struct dis_state *ds, uint32_t addr);
+static uint32_t dis_insn_size(const struct chip8_insn *insn);
+static int dis_ends_block(const struct chip8_insn *insn);
+static int dis_edges(const struct dis_state *ds, uint32_t addr,
+                     const struct chip8_insn *insn, struct dis_edge *edges);
+static void dis_descend(struct dis_state *ds);
+static void dis_build_blocks(struct dis_state *ds);
+static void dis_find_loops(struct dis_state *ds);
+static void dis_scan(struct dis_state *ds);
+static void dis_write(struct dis_state *ds, uint32_t addr, int known,
+                      uint16_t i, uint32_t len);
+static uint8_t dis_quirks_used(const struct chip8_insn *insn);
+static void dis_text(const struct dis_state *ds, uint32_t addr, char *buf,
+                     size_t size);
+static void dis_print(const struct dis_state *ds);
+static uint32_t dis_print_insn(const struct dis_state *ds, uint32_t addr,
+                               const struct dis_block **block);
+static uint32_t dis_print_data(const struct dis_state *ds, uint32_t addr);
+static int dis_write_dot(const struct dis_state *ds, const char *path);
+
+static void usage(void)
+{
+    printf("Usage: chip8-dis [options] <rom>\n"
+           "  -g <file>     Also write the control-flow graph as Graphviz\n"
+           "  -q <profile>  Quirks to analyse with: none (default), chip8,\n"
+           "                schip or xochip\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct dis_state *ds = calloc(1, sizeof(*ds));
+    const char *rom_path = NULL;
+    const char *dot_path = NULL;
+    int status = 0;
+
+    if (!ds || chip8_init(&ds->ctx)) {
+        return 1;
+    }
+
+    for (int arg = 1; arg < argc; ++arg) {
+        const char *opt = argv[arg];
+
+        if (opt[0] != '-') {
+            if (rom_path) {
+                usage();
+                return 1;
+            }
+
+            rom_path = opt;
+            continue;
+        }
+
+        if (arg + 1 >= argc) {
+            usage();
+            return 1;
+        }
+
+        const char *value = argv[++arg];
+
+        switch (opt[1]) {
+        case 'g':
+            dot_path = value;
+            break;
+
+        case 'q':
+            if ((ds->quirks = chip8_quirks_parse(value)) < 0) {
+                usage();
+                return 1;
+            }
+            break;
+
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (!rom_path) {
+        usage();
+        return 1;
+    }
+
+    if (dis_load(ds, rom_path)) {
+        return 1;
+    }
+
+    dis_descend(ds);
+    dis_build_blocks(ds);
+    dis_find_loops(ds);
+    dis_scan(ds);
+    dis_print(ds);
+
+    if (dot_path && dis_write_dot(ds, dot_path)) {
+        printf("Failed to write %s\n", dot_path);
+        status = 1;
+    }
+
+    free(ds);
+
+    return status;
+}
+
+static int dis_load(struct dis_state *ds, const char *path)
+{
+    const uint8_t *data;
+    size_t size;
+    int status;
+
+    if (platform_map_file(path, &data, &size)) {
+        printf("Failed to read %s\n", path);
+        return 1;
+    }
+
+    status = chip8_loadrom_mem(&ds->ctx, data, size);
+    platform_unmap_file(data, size);
+
+    if (status != CHIP8_ROM_OK) {
+        printf("%s: %s\n", path, chip8_rom_status_string(status));
+        return 1;
+    }
+
+    ds->path = path;
+    ds->rom_end = PROGRAM_START + (uint32_t)size;
+
+    return 0;
+}
+
+static int dis_in_rom(const struct dis_state *ds, uint32_t addr)
+{
+    /* The core stops at PROGRAM_END, so nothing runs from there */
+    return addr >= PROGRAM_START && addr < ds->rom_end && addr < PROGRAM_END;
+}
+
+static void dis_decode(const struct dis_state *ds, uint32_t addr,
+                       struct chip8_insn *insn)
+{
+    chip8_decode((uint16_t)(ds->ctx.mem[addr] << 8 | ds->ctx.mem[addr + 1]),
+                 insn);
+}
+
+static uint16_t dis_long(const struct dis_state *ds, uint32_t addr)
+{
+    /* The address word after an F000 at addr */
+    return (uint16_t)(ds->ctx.mem[(addr + 2) % RAM_SIZE] << 8
+                      | ds->ctx.mem[(addr + 3) % RAM_SIZE]);
+}
+
+static uint32_t dis_insn_size(const struct chip8_insn *insn)
+{
+    return insn->op == CHIP8_OP_F000 ? 4 : 2;
+}
+
+static int dis_ends_block(const struct chip8_insn *insn)
+{
+    /* As in the block cache; invalid opcodes stop the machine */
+    return insn->op == CHIP8_OP_invalid
+           || (chip8_op_flags(insn->op)
+               & (CHIP8_OPF_BRANCH | CHIP8_OPF_WRITE));
+}
+
+static int dis_edges(const struct dis_state *ds, uint32_t addr,
+                     const struct chip8_insn *insn, struct dis_edge *edges)
+{
+    /* Fills in the successors of the instruction at addr; returns how
+     * many there are */
+    uint32_t next = addr + dis_insn_size(insn);
+    int count = 0;
+
+    memset(edges, 0, sizeof(*edges) * DIS_MAX_EDGES);
+
+    switch (insn->op) {
+    case CHIP8_OP_invalid:
+    case CHIP8_OP_00EE:
+    case CHIP8_OP_00FD:
+    case CHIP8_OP_Bnnn:
+        /* Nothing that can be followed statically */
+        break;
+
+    case CHIP8_OP_1nnn:
+        edges[count].to = insn->nnn;
+        edges[count++].kind = DIS_EDGE_JUMP;
+        break;
+
+    case CHIP8_OP_2nnn:
+        edges[count].to = insn->nnn;
+        edges[count++].kind = DIS_EDGE_CALL;
+        edges[count].to = next;
+        edges[count++].kind = DIS_EDGE_NEXT;
+        break;
+
+    case CHIP8_OP_3xkk:
+    case CHIP8_OP_4xkk:
+    case CHIP8_OP_5xy0:
+    case CHIP8_OP_9xy0:
+    case CHIP8_OP_Ex9E:
+    case CHIP8_OP_ExA1:
+        edges[count].to = next;
+        edges[count++].kind = DIS_EDGE_NEXT;
+
+        if (next < PROGRAM_END) {
+            edges[count].to = next + CHIP8_SKIP_SIZE(ds->ctx.mem, next);
+            edges[count++].kind = DIS_EDGE_SKIP;
+        }
+        break;
+
+    default:
+        edges[count].to = next;
+        edges[count++].kind = DIS_EDGE_NEXT;
+        break;
+    }
+
+    return count;
+}
+
+static void dis_descend(struct dis_state *ds)
+{
+    /* Marks every instruction reachable from PROGRAM_START; an address is
+     * marked as it is queued, so each is queued once */
+    uint32_t count = 0;
+
+    if (!dis_in_rom(ds, PROGRAM_START)) {
+        return;
+    }
+
+    ds->flags[PROGRAM_START] |= DIS_CODE | DIS_LEADER;
+    ds->pending[count++] = PROGRAM_START;
+
+    while (count > 0) {
+        uint32_t addr = ds->pending[--count];
+        struct dis_edge edges[DIS_MAX_EDGES];
+        struct chip8_insn insn;
+        uint32_t size;
+        int edge_count;
+
+        dis_decode(ds, addr, &insn);
+        size = dis_insn_size(&insn);
+        edge_count = dis_edges(ds, addr, &insn, edges);
+        ds->insns++;
+
+        for (uint32_t b = 1; b < size && addr + b < RAM_SIZE; ++b) {
+            ds->flags[addr + b] |= DIS_OPERAND;
+        }
+
+        if (insn.op == CHIP8_OP_invalid) {
+            ds->invalid++;
+        } else if (insn.op == CHIP8_OP_Bnnn) {
+            ds->indirect++;
+        }
+
+        for (int e = 0; e < edge_count; ++e) {
+            uint32_t to = edges[e].to;
+
+            if (!dis_in_rom(ds, to)) {
+                ds->flags[addr] |= DIS_LEAVES_ROM;
+                ds->exits++;
+                continue;
+            }
+
+            if (dis_ends_block(&insn)) {
+                ds->flags[to] |= DIS_LEADER;
+            }
+
+            if (edges[e].kind == DIS_EDGE_CALL
+                && !(ds->flags[to] & DIS_CALLED)) {
+                ds->flags[to] |= DIS_CALLED;
+                ds->subroutines++;
+            }
+
+            if (!(ds->flags[to] & DIS_CODE)) {
+                ds->flags[to] |= DIS_CODE;
+                ds->pending[count++] = to;
+            }
+        }
+    }
+}
+
+static void dis_build_blocks(struct dis_state *ds)
+{
+    /* One block per leader, in address order, running until an
+     * instruction that ends it or the next leader */
+    for (uint32_t start = PROGRAM_START; start < ds->rom_end; ++start) {
+        struct dis_block *block;
+        uint32_t addr = start;
+
+        if ((ds->flags[start] & (DIS_CODE | DIS_LEADER))
+            != (DIS_CODE | DIS_LEADER)) {
+            continue;
+        }
+
+        block = &ds->blocks[ds->block_count++];
+        block->start = (uint16_t)start;
+        ds->block_at[start] = ds->block_count;
+
+        for (;;) {
+            struct dis_edge edges[DIS_MAX_EDGES];
+            struct chip8_insn insn;
+            uint32_t next;
+            int edge_count;
+
+            dis_decode(ds, addr, &insn);
+            edge_count = dis_edges(ds, addr, &insn, edges);
+            next = addr + dis_insn_size(&insn);
+            block->last = (uint16_t)addr;
+
+            if (!dis_ends_block(&insn) && dis_in_rom(ds, next)
+                && !(ds->flags[next] & DIS_LEADER)) {
+                addr = next;
+                continue;
+            }
+
+            for (int e = 0; e < edge_count; ++e) {
+                if (dis_in_rom(ds, edges[e].to)) {
+                    block->edges[block->edge_count++] = edges[e];
+                }
+            }
+
+            break;
+        }
+    }
+}
+
+static void dis_find_loops(struct dis_state *ds)
+{
+    /* Depth-first over the blocks from the entry; an edge to a block that
+     * is still on the stack is a back edge, and its target a loop header */
+    uint32_t *stack = ds->pending;
+    uint32_t depth = 0;
+
+    if (ds->block_count == 0) {
+        return;
+    }
+
+    stack[depth++] = ds->block_at[PROGRAM_START] - 1;
+    ds->blocks[stack[0]].visit = DIS_VISIT_ACTIVE;
+
+    while (depth > 0) {
+        struct dis_block *block = &ds->blocks[stack[depth - 1]];
+        struct dis_edge *edge;
+        uint32_t to;
+
+        if (block->next_edge == block->edge_count) {
+            block->visit = DIS_VISIT_DONE;
+            --depth;
+            continue;
+        }
+
+        edge = &block->edges[block->next_edge++];
+        to = ds->block_at[edge->to] - 1;
+
+        if (ds->blocks[to].visit == DIS_VISIT_ACTIVE) {
+            edge->back = 1;
+
+            if (!(ds->flags[edge->to] & DIS_LOOP)) {
+                ds->flags[edge->to] |= DIS_LOOP;
+                ds->loops++;
+            }
+        } else if (ds->blocks[to].visit == DIS_VISIT_NEW) {
+            ds->blocks[to].visit = DIS_VISIT_ACTIVE;
+            stack[depth++] = to;
+        }
+    }
+}
+
+static void dis_scan(struct dis_state *ds)
+{
+    /* Places memory writes and counts quirk-sensitive instructions. I is
+     * unknown at the start of every block; writes end blocks, so only
+     * loads can move it on afterwards. */
+    uint8_t quirks = chip8_quirk_flags(ds->quirks);
+
+    for (uint32_t b = 0; b < ds->block_count; ++b) {
+        const struct dis_block *block = &ds->blocks[b];
+        uint16_t i = 0;
+        int known = 0;
+
+        for (uint32_t addr = block->start; addr <= block->last;) {
+            struct chip8_insn insn;
+            uint8_t used;
+
+            dis_decode(ds, addr, &insn);
+            used = dis_quirks_used(&insn);
+
+            for (uint32_t q = 0; q < DIS_QUIRK_COUNT; ++q) {
+                if (used & dis_quirks[q].quirk) {
+                    ds->quirk_counts[q]++;
+                }
+            }
+
+            switch (insn.op) {
+            case CHIP8_OP_Annn:
+                i = insn.nnn;
+                known = 1;
+                break;
+
+            case CHIP8_OP_F000:
+                i = dis_long(ds, addr);
+                known = 1;
+                break;
+
+            case CHIP8_OP_Fx55:
+                dis_write(ds, addr, known, i, insn.x + 1u);
+                break;
+
+            case CHIP8_OP_Fx65:
+                if (quirks & CHIP8_QUIRK_LOAD_STORE_I) {
+                    i = (uint16_t)(i + insn.x + 1);
+                }
+                break;
+
+            case CHIP8_OP_Fx1E:
+                known = 0;
+                break;
+
+            default:
+                break;
+            }
+
+            addr += dis_insn_size(&insn);
+        }
+    }
+}
+
+static void dis_write(struct dis_state *ds, uint32_t addr, int known,
+                      uint16_t i, uint32_t len)
+{
+    /* An Fx55 at addr writing len bytes from I */
+    int hits_code = 0;
+
+    if (!known) {
+        ds->flags[addr] |= DIS_BLIND_WRITE;
+        ds->blind_writes++;
+        return;
+    }
+
+    for (uint32_t b = 0; b < len; ++b) {
+        uint32_t to = (i + b) % RAM_SIZE;
+
+        if (ds->flags[to] & (DIS_CODE | DIS_OPERAND)) {
+            hits_code = 1;
+        }
+
+        ds->flags[to] |= DIS_WRITTEN;
+    }
+
+    if (hits_code) {
+        ds->flags[addr] |= DIS_WRITES_CODE;
+        ds->write_to[addr] = i;
+        ds->code_writes++;
+    }
+}
+
+static uint8_t dis_quirks_used(const struct chip8_insn *insn)
+{
+    /* CHIP8_QUIRK_* bits that can change what insn does */
+    switch (insn->op) {
+    case CHIP8_OP_8xy1:
+    case CHIP8_OP_8xy2:
+    case CHIP8_OP_8xy3:
+        return CHIP8_QUIRK_VF_RESET;
+
+    case CHIP8_OP_8xy6:
+    case CHIP8_OP_8xyE:
+        return insn->x != insn->y ? CHIP8_QUIRK_SHIFT_VY : 0;
+
+    case CHIP8_OP_Fx55:
+    case CHIP8_OP_Fx65:
+        return CHIP8_QUIRK_LOAD_STORE_I;
+
+    case CHIP8_OP_Bnnn:
+        return CHIP8_QUIRK_JUMP_VX;
+
+    case CHIP8_OP_Dxyn:
+        return CHIP8_QUIRK_CLIP;
+
+    default:
+        return 0;
+    }
+}
+
+static void dis_text(const struct dis_state *ds, uint32_t addr, char *buf,
+                     size_t size)
+{
+    /* chip8_disasm, with F000's address filled in from memory */
+    struct chip8_insn insn;
+
+    dis_decode(ds, addr, &insn);
+
+    if (insn.op == CHIP8_OP_F000) {
+        snprintf(buf, size, "LD I, %04X", dis_long(ds, addr));
+    } else {
+        chip8_disasm(&insn, buf, size);
+    }
+}
+
+static void dis_print(const struct dis_state *ds)
+{
+    const struct dis_block *block = NULL;
+    uint32_t addr = PROGRAM_START;
+
+    printf("; %s: %u bytes at %03X-%03X, quirks %s\n", ds->path,
+           ds->rom_end - PROGRAM_START, PROGRAM_START, ds->rom_end - 1,
+           chip8_quirks_name(ds->quirks));
+    printf("; %u instructions in %u blocks, %u subroutines, %u loops\n",
+           ds->insns, ds->block_count, ds->subroutines, ds->loops);
+    printf("; %u indirect jumps, %u invalid opcodes, %u exits from the ROM\n",
+           ds->indirect, ds->invalid, ds->exits);
+    printf("; %u writes into code, %u writes with I unknown\n",
+           ds->code_writes, ds->blind_writes);
+    printf("; quirk-sensitive instructions:");
+
+    for (uint32_t q = 0; q < DIS_QUIRK_COUNT; ++q) {
+        printf("%s %s %u", q > 0 ? "," : "", dis_quirks[q].name,
+               ds->quirk_counts[q]);
+    }
+
+    printf("\n");
+
+    while (addr < ds->rom_end) {
+        if (ds->flags[addr] & DIS_CODE) {
+            addr = dis_print_insn(ds, addr, &block);
+        } else {
+            addr = dis_print_data(ds, addr);
+        }
+    }
+}
+
+static uint32_t dis_print_insn(const struct dis_state *ds, uint32_t addr,
+                               const struct dis_block **block)
+{
+    /* One line for the instruction at addr, with a label first if it
+     * starts a block; returns the address to carry on from */
+    uint16_t flags = ds->flags[addr];
+    struct chip8_insn insn;
+    char text[32];
+    char notes[128] = "";
+    size_t len = 0;
+    uint32_t size;
+
+    dis_decode(ds, addr, &insn);
+    dis_text(ds, addr, text, sizeof(text));
+    size = dis_insn_size(&insn);
+
+    if (ds->block_at[addr]) {
+        *block = &ds->blocks[ds->block_at[addr] - 1];
+
+        printf("\nL%03X:%s%s\n", addr,
+               flags & DIS_CALLED ? " ; subroutine" : "",
+               flags & DIS_LOOP ? " ; loop" : "");
+    }
+
+    if (flags & DIS_WRITES_CODE) {
+        len += snprintf(&notes[len], sizeof(notes) - len,
+                        " ; writes code at %03X", ds->write_to[addr]);
+    }
+
+    if (flags & DIS_BLIND_WRITE) {
+        len += snprintf(&notes[len], sizeof(notes) - len, " ; I unknown");
+    }
+
+    if (insn.op == CHIP8_OP_Bnnn) {
+        len += snprintf(&notes[len], sizeof(notes) - len,
+                        " ; indirect via V%X",
+                        chip8_quirk_flags(ds->quirks) & CHIP8_QUIRK_JUMP_VX
+                        ? insn.x : 0);
+    }
+
+    if (flags & DIS_LEAVES_ROM) {
+        len += snprintf(&notes[len], sizeof(notes) - len,
+                        " ; leaves the ROM");
+    }
+
+    if (*block && (*block)->last == addr) {
+        for (int e = 0; e < (*block)->edge_count; ++e) {
+            if ((*block)->edges[e].back) {
+                len += snprintf(&notes[len], sizeof(notes) - len,
+                                " ; loops to L%03X", (*block)->edges[e].to);
+            }
+        }
+    }
+
+    /* Notes line up after the text; F000's address goes in the operand
+     * column */
+    if (size == 4) {
+        printf("    %03X  %04X %04X  %-*s%s\n", addr, insn.opcode,
+               dis_long(ds, addr), len > 0 ? 20 : 0, text, notes);
+    } else {
+        printf("    %03X  %04X       %-*s%s\n", addr, insn.opcode,
+               len > 0 ? 20 : 0, text, notes);
+    }
+
+    /* Code that jumps into the middle of an instruction overlaps it */
+    for (uint32_t b = 1; b < size; ++b) {
+        if (addr + b >= ds->rom_end || (ds->flags[addr + b] & DIS_CODE)) {
+            return addr + b;
+        }
+    }
+
+    return addr + size;
+}
+
+static uint32_t dis_print_data(const struct dis_state *ds, uint32_t addr)
+{
+    /* Up to eight bytes that aren't code on one line */
+    uint32_t end = addr;
+
+    printf("    %03X  db", addr);
+
+    while (end < ds->rom_end && end - addr < 8
+           && !(ds->flags[end] & DIS_CODE)) {
+        printf("%s #%02X", end > addr ? "," : "", ds->ctx.mem[end]);
+        ++end;
+    }
+
+    printf("\n");
+
+    return end;
+}
+
+static int dis_write_dot(const struct dis_state *ds, const char *path)
+{
+    /* One box per block listing its instructions; calls are dashed, back
+     * edges red, loop headers doubled and blocks that write code red */
+    FILE *f = fopen(path, "w");
+
+    if (!f) {
+        return 1;
+    }
+
+    fprintf(f, "digraph chip8 {\n"
+               "    node [shape=box, fontname=\"monospace\"];\n");
+
+    for (uint32_t b = 0; b < ds->block_count; ++b) {
+        const struct dis_block *block = &ds->blocks[b];
+        const char *color = "black";
+
+        fprintf(f, "    L%03X [label=\"L%03X:\\l", block->start,
+                block->start);
+
+        for (uint32_t addr = block->start; addr <= block->last;) {
+            struct chip8_insn insn;
+            char text[32];
+
+            dis_decode(ds, addr, &insn);
+            dis_text(ds, addr, text, sizeof(text));
+            fprintf(f, "%03X  %s\\l", addr, text);
+
+            if (ds->flags[addr] & DIS_WRITES_CODE) {
+                color = "red";
+            }
+
+            addr += dis_insn_size(&insn);
+        }
+
+        fprintf(f, "\", color=%s, peripheries=%d];\n", color,
+                ds->flags[block->start] & DIS_LOOP ? 2 : 1);
+    }
+
+    for (uint32_t b = 0; b < ds->block_count; ++b) {
+        const struct dis_block *block = &ds->blocks[b];
+
+        for (int e = 0; e < block->edge_count; ++e) {
+            const struct dis_edge *edge = &block->edges[e];
+
+            fprintf(f, "    L%03X -> L%03X [style=%s, color=%s];\n",
+                    block->start, edge->to,
+                    edge->kind == DIS_EDGE_CALL ? "dashed" : "solid",
+                    edge->back ? "red" : "black");
+        }
+    }
+
+    fprintf(f, "}\n");
+
+    return fclose(f) != 0;
+}
@@ -0,0 +1,762 @@
+#include "chip8.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ROM fuzzer. An input is two bytes of initial key state (bit k for key k,
+ * little-endian) followed by the ROM. Each input runs from a chip8_reset
+ * for a bounded number of instructions; before every instruction the
+ * harness checks whether it would fault, and stops the run there instead
+ * of executing it, so bad ROMs are classified without undefined behaviour.
+ * Runs that reach the same machine state twice are infinite loops, and
+ * runs that jump to PROGRAM_END or beyond, where the core stops, halt.
+ *
+ * Coverage is the (previous pc, pc) edges taken, with AFL-style hit count
+ * buckets. Built with -DCHIP8_LIBFUZZER=1 this is a libFuzzer target: the
+ * edge counters go to libFuzzer as extra counters and faulting inputs
+ * abort. Otherwise main() runs its own mutate-and-execute loop. */
+
+#ifndef CHIP8_LIBFUZZER
+#define CHIP8_LIBFUZZER 0
+#endif
+
+#define FUZZ_KEY_BYTES 2
+#define FUZZ_INPUT_MAX (FUZZ_KEY_BYTES + CHIP8_ROM_MAX)
+
+/* Instructions between timer ticks, as in the headless runner */
+#define FUZZ_TICK_CYCLES 10
+
+#define FUZZ_MAP_SIZE 65536
+#define FUZZ_CORPUS_MAX 4096
+
+/* Runs that last the whole budget cost about twice the bare core's time
+ * per instruction, so the run rate falls with -c; most mutants stop far
+ * sooner */
+#define FUZZ_DEFAULT_CYCLES 1000
+#define FUZZ_MAX_MUTATIONS 4
+
+enum fuzz_result {
+    FUZZ_OK,
+    FUZZ_STACK_OVERFLOW,
+    FUZZ_STACK_UNDERFLOW,
+    FUZZ_MEM_READ_OOB,
+    FUZZ_MEM_WRITE_OOB,
+    FUZZ_KEY_OOB,
+    FUZZ_HANG,
+
+    /* Jumped to PROGRAM_END or past it, where the core stops */
+    FUZZ_HALT,
+
+    /* Stopped at an opcode the core doesn't implement; not saved */
+    FUZZ_INVALID_OPCODE,
+    FUZZ_RESULT_COUNT
+};
+
+static const char *const result_names[FUZZ_RESULT_COUNT] = {
+    "ok", "stack-overflow", "stack-underflow", "mem-read-oob",
+    "mem-write-oob", "key-oob", "hang", "halt", "invalid-opcode"
+};
+
+/* What the hang check compares; only filled in when pc matches */
+struct fuzz_snapshot {
+    uint64_t rng;
+    uint32_t display_gen;
+    uint32_t writes;
+    uint16_t pc;
+    uint16_t i;
+    uint16_t stack[STACK_SIZE];
+    uint8_t registers[16];
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t tick_phase;
+};
+
+struct fuzz_input {
+    uint8_t *data;
+    size_t size;
+};
+
+struct fuzz_state {
+    struct chip8_context ctx;
+    uint32_t cycles;
+    uint64_t rng;
+
+    /* Every opcode run through chip8_decode once (512KB), since most
+     * instructions of a run are decoded many times */
+    struct chip8_insn decoded[0xFFFF + 1];
+
+    /* Edges hit by the current run, to check and clear only those */
+    uint16_t touched[FUZZ_MAP_SIZE];
+    uint32_t touched_count;
+
+    /* Hit count buckets seen so far per edge */
+    uint8_t seen[FUZZ_MAP_SIZE];
+    uint32_t edges;
+
+    struct fuzz_input corpus[FUZZ_CORPUS_MAX];
+    int corpus_count;
+
+    /* Faults already saved, by result and pc */
+    uint8_t saved[FUZZ_RESULT_COUNT][RAM_SIZE];
+    uint64_t results[FUZZ_RESULT_COUNT];
+    const char *out_dir;
+
+    /* Where the last run stopped */
+    uint16_t fault_pc;
+};
+
+#if CHIP8_LIBFUZZER
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t coverage[FUZZ_MAP_SIZE];
+
+static int fuzz_init(struct fuzz_state *fz);
+static int fuzz_exec(struct fuzz_state *fz, const uint8_t *data, size_t size);
+static int fuzz_check(const struct chip8_context *ctx,
+                      const struct chip8_insn *in);
+static void fuzz_snapshot(const struct chip8_context *ctx, uint32_t writes,
+                          uint32_t cycle, struct fuzz_snapshot *snap);
+
+#if CHIP8_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static struct fuzz_state *fz;
+    int result;
+
+    if (!fz) {
+        if ((fz = calloc(1, sizeof(*fz))) == NULL || fuzz_init(fz)) {
+            abort();
+        }
+    }
+
+    result = fuzz_exec(fz, data, size);
+
+    /* Hangs, halts and invalid opcodes are only reported; the memory and
+     * stack faults would crash or corrupt a frontend */
+    if (result != FUZZ_OK && result != FUZZ_HANG && result != FUZZ_HALT
+        && result != FUZZ_INVALID_OPCODE) {
+        fprintf(stderr, "%s at %03x\n", result_names[result], fz->fault_pc);
+        abort();
+    }
+
+    return 0;
+}
+
+#else
+
+static int fuzz_add(struct fuzz_state *fz, const uint8_t *data, size_t size);
+static int fuzz_new_coverage(struct fuzz_state *fz);
+static void fuzz_clear_coverage(struct fuzz_state *fz);
+static size_t fuzz_mutate(struct fuzz_state *fz, uint8_t *buf, size_t size);
+static void fuzz_triage(struct fuzz_state *fz, int result,
+                        const uint8_t *data, size_t size);
+static void fuzz_add_seed(const char *path, void *arg);
+static int fuzz_run_file(struct fuzz_state *fz, const char *path);
+static void fuzz_report(const struct fuzz_state *fz, uint64_t execs,
+                        double seconds);
+static uint64_t fuzz_random(struct fuzz_state *fz);
+
+static void usage(void)
+{
+    printf("Usage: chip8-fuzz [options]\n"
+           "  -c <cycles>   Instructions per run (default %d)\n"
+           "  -d <dir>      Seed the corpus with every ROM in a directory\n"
+           "  -n <runs>     Stop after this many runs (default: never)\n"
+           "  -o <dir>      Save the first input of each fault and pc here\n"
+           "  -s <seed>     Mutation seed\n"
+           "  -t <seconds>  Stop after this long\n"
+           "  -x <file>     Run one saved input and print its result\n",
+           FUZZ_DEFAULT_CYCLES);
+}
+
+int main(int argc, char **argv)
+{
+    struct fuzz_state *fz = calloc(1, sizeof(*fz));
+    uint8_t input[FUZZ_INPUT_MAX];
+    const char *replay_path = NULL;
+    uint64_t max_execs = 0;
+    double max_seconds = 0.0;
+    uint64_t execs = 0;
+    uint64_t start;
+    uint64_t last_report;
+
+    if (!fz || fuzz_init(fz)) {
+        return 1;
+    }
+
+    fz->rng = platform_time_ns() | 1;
+
+    for (int arg = 1; arg < argc; ++arg) {
+        const char *opt = argv[arg];
+
+        if (opt[0] != '-' || arg + 1 >= argc) {
+            usage();
+            return 1;
+        }
+
+        const char *value = argv[++arg];
+
+        switch (opt[1]) {
+        case 'c':
+            fz->cycles = (uint32_t)strtoul(value, NULL, 10);
+            break;
+
+        case 'd':
+            if (platform_list_dir(value, fuzz_add_seed, fz)) {
+                printf("Failed to read corpus directory %s\n", value);
+                return 1;
+            }
+            break;
+
+        case 'n':
+            max_execs = strtoull(value, NULL, 10);
+            break;
+
+        case 'o':
+            fz->out_dir = value;
+            break;
+
+        case 's':
+            fz->rng = strtoull(value, NULL, 0) | 1;
+            break;
+
+        case 't':
+            max_seconds = atof(value);
+            break;
+
+        case 'x':
+            replay_path = value;
+            break;
+
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (fz->cycles == 0) {
+        usage();
+        return 1;
+    }
+
+    if (replay_path) {
+        return fuzz_run_file(fz, replay_path);
+    }
+
+    if (fz->corpus_count == 0) {
+        /* No keys, and a ROM that only jumps to itself */
+        static const uint8_t seed[] = { 0x00, 0x00, 0x12, 0x00 };
+
+        fuzz_exec(fz, seed, sizeof(seed));
+        fuzz_new_coverage(fz);
+        fuzz_add(fz, seed, sizeof(seed));
+    }
+
+    start = platform_time_ns();
+    last_report = start;
+
+    while (max_execs == 0 || execs < max_execs) {
+        const struct fuzz_input *parent =
+            &fz->corpus[fuzz_random(fz) % fz->corpus_count];
+        size_t size = parent->size;
+        int result;
+
+        memcpy(input, parent->data, size);
+        size = fuzz_mutate(fz, input, size);
+
+        result = fuzz_exec(fz, input, size);
+        fz->results[result]++;
+        ++execs;
+
+        if (fuzz_new_coverage(fz)) {
+            fuzz_add(fz, input, size);
+        }
+
+        if (result != FUZZ_OK && result != FUZZ_INVALID_OPCODE) {
+            fuzz_triage(fz, result, input, size);
+        }
+
+        /* The clock is only read every so often */
+        if ((execs & 0xFFF) == 0) {
+            uint64_t now = platform_time_ns();
+
+            if (now - last_report >= 1000000000u) {
+                fuzz_report(fz, execs, (now - start) / 1e9);
+                last_report = now;
+            }
+
+            if (max_seconds > 0.0 && (now - start) / 1e9 >= max_seconds) {
+                break;
+            }
+        }
+    }
+
+    fuzz_report(fz, execs, (platform_time_ns() - start) / 1e9);
+
+    return 0;
+}
+
+static int fuzz_add(struct fuzz_state *fz, const uint8_t *data, size_t size)
+{
+    /* Keeps a copy of an input that found new coverage; returns 1 if the
+     * corpus is full */
+    struct fuzz_input *entry;
+
+    if (fz->corpus_count == FUZZ_CORPUS_MAX) {
+        return 1;
+    }
+
+    entry = &fz->corpus[fz->corpus_count];
+
+    if ((entry->data = malloc(size)) == NULL) {
+        return 1;
+    }
+
+    memcpy(entry->data, data, size);
+    entry->size = size;
+    fz->corpus_count++;
+
+    return 0;
+}
+
+static int fuzz_new_coverage(struct fuzz_state *fz)
+{
+    /* Folds the last run's edges into seen; returns 1 if any edge was new
+     * or hit a new count bucket. Clears the edges for the next run. */
+    int found = 0;
+
+    for (uint32_t t = 0; t < fz->touched_count; ++t) {
+        uint16_t edge = fz->touched[t];
+        uint8_t hits = coverage[edge];
+        uint8_t bucket;
+
+        /* 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+ */
+        if (hits < 4) {
+            bucket = (uint8_t)(1u << (hits - 1));
+        } else if (hits < 8) {
+            bucket = 0x08;
+        } else if (hits < 16) {
+            bucket = 0x10;
+        } else if (hits < 32) {
+            bucket = 0x20;
+        } else if (hits < 128) {
+            bucket = 0x40;
+        } else {
+            bucket = 0x80;
+        }
+
+        if (!(fz->seen[edge] & bucket)) {
+            if (fz->seen[edge] == 0) {
+                fz->edges++;
+            }
+
+            fz->seen[edge] |= bucket;
+            found = 1;
+        }
+    }
+
+    fuzz_clear_coverage(fz);
+
+    return found;
+}
+
+static void fuzz_clear_coverage(struct fuzz_state *fz)
+{
+    for (uint32_t t = 0; t < fz->touched_count; ++t) {
+        coverage[fz->touched[t]] = 0;
+    }
+
+    fz->touched_count = 0;
+}
+
+static size_t fuzz_mutate(struct fuzz_state *fz, uint8_t *buf, size_t size)
+{
+    /* A few random edits to an input of at least FUZZ_KEY_BYTES; returns
+     * the new size */
+    static const uint16_t interesting[] = {
+        0x00EE, 0x2200, 0x1200, 0xF055, 0xFF55, 0xF065, 0xFF65, 0xFF1E,
+        0xD01F, 0xE09E, 0xE0A1, 0xF00A, 0xB200, 0x6F00, 0x6FFF, 0xAFFF
+    };
+    int count = 1 + (int)(fuzz_random(fz) % FUZZ_MAX_MUTATIONS);
+
+    for (int m = 0; m < count; ++m) {
+        uint64_t r = fuzz_random(fz);
+        size_t rom = size - FUZZ_KEY_BYTES;
+        size_t at = FUZZ_KEY_BYTES + (rom ? (r >> 8) % rom : 0);
+
+        switch (r % 8) {
+        case 0:
+            /* Flip a bit */
+            if (rom) {
+                buf[at] ^= (uint8_t)(1u << ((r >> 32) & 7));
+            }
+            break;
+
+        case 1:
+            /* Random byte */
+            if (rom) {
+                buf[at] = (uint8_t)(r >> 40);
+            }
+            break;
+
+        case 2:
+        case 3: {
+            /* An instruction at an even address, random or one that
+             * tends to reach the fault checks */
+            uint16_t opcode = (r & 4)
+                              ? interesting[(r >> 32) % (sizeof(interesting)
+                                                 / sizeof(interesting[0]))]
+                                | (uint16_t)((r >> 48) & 0x0F00)
+                              : (uint16_t)(r >> 40);
+
+            at &= ~(size_t)1;
+
+            if (at + 2 > size) {
+                if (size + 2 > FUZZ_INPUT_MAX) {
+                    break;
+                }
+
+                at = size & ~(size_t)1;
+                size = at + 2;
+            }
+
+            buf[at] = (uint8_t)(opcode >> 8);
+            buf[at + 1] = (uint8_t)opcode;
+            break;
+        }
+
+        case 4:
+            /* Copy a run of bytes within the ROM */
+            if (rom > 1) {
+                size_t from = FUZZ_KEY_BYTES + (r >> 32) % rom;
+                size_t len = 1 + (r >> 16) % 16;
+
+                if (from + len > size) {
+                    len = size - from;
+                }
+
+                if (at + len > size) {
+                    len = size - at;
+                }
+
+                memmove(buf + at, buf + from, len);
+            }
+            break;
+
+        case 5: {
+            /* Splice: keep a prefix, take the rest from another input */
+            const struct fuzz_input *other =
+                &fz->corpus[(r >> 32) % fz->corpus_count];
+
+            if (other->size > at) {
+                memcpy(buf + at, other->data + at, other->size - at);
+                size = other->size;
+            }
+            break;
+        }
+
+        case 6:
+            /* Toggle a key */
+            buf[(r >> 32) & 1] ^= (uint8_t)(1u << ((r >> 40) & 7));
+            break;
+
+        case 7:
+            /* Grow with random bytes or shrink */
+            if ((r & 0x100) && size + 16 <= FUZZ_INPUT_MAX) {
+                for (int b = 0; b < 16; ++b) {
+                    buf[size++] = (uint8_t)(fuzz_random(fz) >> 24);
+                }
+            } else if (rom > 2) {
+                size -= 1 + (r >> 32) % (rom - 1);
+            }
+            break;
+        }
+    }
+
+    return size;
+}
+
+static void fuzz_triage(struct fuzz_state *fz, int result,
+                        const uint8_t *data, size_t size)
+{
+    /* Saves the first input for each kind of fault at each pc */
+    uint16_t pc = fz->fault_pc % RAM_SIZE;
+    char path[4096];
+    FILE *f;
+
+    if (fz->saved[result][pc]) {
+        return;
+    }
+
+    fz->saved[result][pc] = 1;
+    printf("new %s at %03x\n", result_names[result], pc);
+
+    if (!fz->out_dir) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s-%03x.bin", fz->out_dir,
+             result_names[result], pc);
+
+    if ((f = fopen(path, "wb")) == NULL) {
+        printf("Failed to write %s\n", path);
+        return;
+    }
+
+    fwrite(data, 1, size, f);
+    fclose(f);
+}
+
+static void fuzz_add_seed(const char *path, void *arg)
+{
+    /* A ROM from the seed directory, with no keys held */
+    struct fuzz_state *fz = arg;
+    uint8_t input[FUZZ_INPUT_MAX];
+    const uint8_t *data;
+    size_t size;
+
+    if (platform_map_file(path, &data, &size)) {
+        return;
+    }
+
+    if (size > 0 && size <= CHIP8_ROM_MAX) {
+        memset(input, 0, FUZZ_KEY_BYTES);
+        memcpy(input + FUZZ_KEY_BYTES, data, size);
+
+        fuzz_exec(fz, input, FUZZ_KEY_BYTES + size);
+        fuzz_new_coverage(fz);
+        fuzz_add(fz, input, FUZZ_KEY_BYTES + size);
+    }
+
+    platform_unmap_file(data, size);
+}
+
+static int fuzz_run_file(struct fuzz_state *fz, const char *path)
+{
+    /* Runs a single saved input; returns 1 if it faults */
+    const uint8_t *data;
+    size_t size;
+    int result;
+
+    if (platform_map_file(path, &data, &size)) {
+        printf("Failed to read %s\n", path);
+        return 1;
+    }
+
+    result = fuzz_exec(fz, data, size);
+    fuzz_clear_coverage(fz);
+    platform_unmap_file(data, size);
+
+    if (result == FUZZ_OK) {
+        printf("%s: ran %u instructions\n", path, fz->cycles);
+    } else {
+        printf("%s: %s at %03x\n", path, result_names[result], fz->fault_pc);
+    }
+
+    return result != FUZZ_OK;
+}
+
+static void fuzz_report(const struct fuzz_state *fz, uint64_t execs,
+                        double seconds)
+{
+    printf("%llu runs, %.0f/s, %d in corpus, %u edges",
+           (unsigned long long)execs, seconds > 0 ? execs / seconds : 0.0,
+           fz->corpus_count, fz->edges);
+
+    for (int r = 1; r < FUZZ_RESULT_COUNT; ++r) {
+        printf(", %s %llu", result_names[r],
+               (unsigned long long)fz->results[r]);
+    }
+
+    printf("\n");
+}
+
+static uint64_t fuzz_random(struct fuzz_state *fz)
+{
+    /* xorshift64* */
+    fz->rng ^= fz->rng >> 12;
+    fz->rng ^= fz->rng << 25;
+    fz->rng ^= fz->rng >> 27;
+
+    return fz->rng * 0x2545F4914F6CDD1Du;
+}
+
+#endif
+
+static int fuzz_init(struct fuzz_state *fz)
+{
+    if (chip8_init(&fz->ctx)) {
+        return 1;
+    }
+
+    for (uint32_t opcode = 0; opcode <= 0xFFFF; ++opcode) {
+        chip8_decode((uint16_t)opcode, &fz->decoded[opcode]);
+    }
+
+    fz->cycles = FUZZ_DEFAULT_CYCLES;
+
+    return 0;
+}
+
+static int fuzz_exec(struct fuzz_state *fz, const uint8_t *data, size_t size)
+{
+    /* One run of an input from power-on; returns a fuzz_result. The edges
+     * taken are left in coverage. */
+    struct chip8_context *ctx = &fz->ctx;
+    struct fuzz_snapshot snap;
+    struct fuzz_snapshot now;
+    uint32_t power = 1;
+    uint32_t lambda = 0;
+    uint32_t writes = 0;
+    uint32_t tick = FUZZ_TICK_CYCLES;
+    uint16_t prev_pc = PROGRAM_START;
+
+    fz->fault_pc = PROGRAM_START;
+
+    if (size <= FUZZ_KEY_BYTES) {
+        return FUZZ_OK;
+    }
+
+    /* Cheap reset: two copies from the power-on template, then the ROM */
+    chip8_reset(ctx);
+
+    if (chip8_loadrom_mem(ctx, data + FUZZ_KEY_BYTES, size - FUZZ_KEY_BYTES)
+        != CHIP8_ROM_OK) {
+        return FUZZ_OK;
+    }
+
+    for (int k = 0; k < 0xF + 1; ++k) {
+        ctx->keys[k] = (data[k >> 3] >> (k & 7)) & 1;
+    }
+
+    fuzz_snapshot(ctx, writes, 0, &snap);
+
+    for (uint32_t cycle = 0; cycle < fz->cycles; ++cycle) {
+        uint16_t pc = ctx->pc;
+        const struct chip8_insn *in;
+        uint32_t edge;
+        int result;
+
+        if (cycle == tick) {
+            chip8_tick_timers(ctx);
+            tick += FUZZ_TICK_CYCLES;
+        }
+
+        if (pc < PROGRAM_END) {
+            in = &fz->decoded[(ctx->mem[pc] << 8) | ctx->mem[pc + 1]];
+
+            if ((result = fuzz_check(ctx, in)) != FUZZ_OK) {
+                fz->fault_pc = pc;
+                return result;
+            }
+
+            /* Memory isn't in the hang snapshot, so count what may change
+             * it instead */
+            if (in->op == CHIP8_OP_Fx33 || in->op == CHIP8_OP_Fx55) {
+                ++writes;
+            }
+
+            /* The instruction checked is the one run */
+            chip8_exec(ctx, in);
+        }
+
+        edge = ((uint32_t)prev_pc * 0x9E3779B1u >> 16 ^ ctx->pc)
+               & (FUZZ_MAP_SIZE - 1);
+        prev_pc = ctx->pc;
+
+        if (coverage[edge] == 0) {
+#if !CHIP8_LIBFUZZER
+            fz->touched[fz->touched_count++] = (uint16_t)edge;
+#endif
+            coverage[edge] = 1;
+        } else if (coverage[edge] != 0xFF) {
+            coverage[edge]++;
+        }
+
+        /* The core never runs from PROGRAM_END on, so this is the end of
+         * the run; Bnnn can get as far as 0x10FE. The jump is the fault. */
+        if (ctx->pc >= PROGRAM_END) {
+            fz->fault_pc = pc;
+            return FUZZ_HALT;
+        }
+
+        /* Brent's cycle detection: the same state twice is a loop that
+         * will never end, since keys don't change within a run. Most
+         * passes through snap.pc differ in I or a register already. */
+        if (ctx->pc == snap.pc && ctx->i == snap.i
+            && memcmp(ctx->registers, snap.registers,
+                      sizeof(snap.registers)) == 0) {
+            fuzz_snapshot(ctx, writes, cycle + 1, &now);
+
+            if (memcmp(&now, &snap, sizeof(now)) == 0) {
+                fz->fault_pc = ctx->pc;
+                return FUZZ_HANG;
+            }
+        }
+
+        if (++lambda == power) {
+            fuzz_snapshot(ctx, writes, cycle + 1, &snap);
+            power *= 2;
+            lambda = 0;
+        }
+    }
+
+    return FUZZ_OK;
+}
+
+static int fuzz_check(const struct chip8_context *ctx,
+                      const struct chip8_insn *in)
+{
+    /* Whether executing in now would step outside the machine */
+    switch (in->op) {
+    case CHIP8_OP_invalid:
+        return FUZZ_INVALID_OPCODE;
+
+    case CHIP8_OP_00EE:
+        return ctx->sp == 0 ? FUZZ_STACK_UNDERFLOW : FUZZ_OK;
+
+    case CHIP8_OP_2nnn:
+        return ctx->sp >= STACK_SIZE ? FUZZ_STACK_OVERFLOW : FUZZ_OK;
+
+    case CHIP8_OP_Dxyn:
+        return ctx->i + chip8_sprite_size(ctx, in->kk & 0x0F) > RAM_SIZE
+               ? FUZZ_MEM_READ_OOB : FUZZ_OK;
+
+    case CHIP8_OP_Ex9E:
+    case CHIP8_OP_ExA1:
+        return ctx->registers[in->x] > 0xF ? FUZZ_KEY_OOB : FUZZ_OK;
+
+    /* Both touch I to I + x */
+    case CHIP8_OP_Fx55:
+        return ctx->i + in->x >= RAM_SIZE ? FUZZ_MEM_WRITE_OOB : FUZZ_OK;
+
+    case CHIP8_OP_Fx65:
+        return ctx->i + in->x >= RAM_SIZE ? FUZZ_MEM_READ_OOB : FUZZ_OK;
+
+    default:
+        return FUZZ_OK;
+    }
+}
+
+static void fuzz_snapshot(const struct chip8_context *ctx, uint32_t writes,
+                          uint32_t cycle, struct fuzz_snapshot *snap)
+{
+    /* Everything a later instruction could depend on, except memory and
+     * the display, which stand in as write and draw counts */
+    memset(snap, 0, sizeof(*snap));
+    snap->rng = ctx->rng;
+    snap->display_gen = ctx->display_gen;
+    snap->writes = writes;
+    snap->pc = ctx->pc;
+    snap->i = ctx->i;
+    memcpy(snap->stack, ctx->stack, ctx->sp * sizeof(snap->stack[0]));
+    memcpy(snap->registers, ctx->registers, sizeof(snap->registers));
+    snap->sp = ctx->sp;
+    snap->delay_timer = ctx->delay_timer;
+    snap->sound_timer = ctx->sound_timer;
+    snap->tick_phase = (uint8_t)(cycle % FUZZ_TICK_CYCLES);
+}
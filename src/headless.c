@@ -0,0 +1,821 @@
+#include "chip8.h"
+#include "batch.h"
+#include "bcache.h"
+#include "jit.h"
+#include "platform.h"
+#include "profile.h"
+#include "quirkdb.h"
+#include "replay.h"
+#include "romlib.h"
+#include "wav.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Runs a batch of ROMs without a window, one chip8_context per ROM, spread
+ * over a pool of worker threads. */
+
+#define DEFAULT_CYCLES_PER_FRAME 10
+#define DEFAULT_FRAMES 600
+#define DEFAULT_MACHINES 64
+#define FRAME_HZ 60
+
+enum headless_replay_result {
+    HEADLESS_REPLAY_MATCH,
+    HEADLESS_REPLAY_MISMATCH,
+    HEADLESS_REPLAY_WRONG_ROM,
+    HEADLESS_REPLAY_WRONG_VARIANT
+};
+
+static const char *const replay_results[] = {
+    "final state matches", "FINAL STATE DIFFERS", "recorded with another ROM",
+    "recorded with another machine variant"
+};
+
+enum headless_mode {
+    HEADLESS_INTERP,
+    HEADLESS_BLOCK,
+    HEADLESS_JIT,
+    HEADLESS_BATCH
+};
+
+struct headless_worker_state {
+    struct chip8_context ctx;
+    struct bcache_context cache;
+    struct jit_context jit;
+    struct chip8_batch batch;
+};
+
+struct headless_job {
+    const struct romlib_entry *rom;
+
+    uint64_t cycles;
+    uint64_t time_ns;
+    uint64_t display_hash;
+    uint16_t pc;
+
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t mismatches;
+    uint64_t vector_steps;
+    uint64_t scalar_steps;
+
+    /* Set if the -w recording couldn't be written */
+    int wav_failed;
+
+    /* Set if the batch machines couldn't be allocated; the ROM isn't run */
+    int batch_failed;
+
+    /* enum headless_replay_result with -r */
+    int replay_result;
+
+    /* enum chip8_quirks the ROM ran with */
+    int quirks;
+
+    /* Where a CHIP8_SAFE core stopped, type CHIP8_FAULT_NONE if it didn't */
+    struct chip8_fault fault;
+
+    struct chip8_profile *profile;
+    uint8_t *mem;
+};
+
+struct headless_pool {
+    struct headless_job *jobs;
+    int job_count;
+    int next_job;
+    platform_mutex lock;
+
+    uint64_t cycles;
+    uint64_t cycles_per_frame;
+    enum headless_mode mode;
+    int verify;
+    int machines;
+    int profile_top;
+    uint64_t seed;
+
+    /* Directory for one WAV recording of the beeper per ROM, or NULL */
+    const char *wav_dir;
+
+    /* Input recording played into every ROM instead of the fixed run */
+    struct replay *replay;
+
+    /* The -q profile for every ROM or -1, and the -Q database or NULL */
+    int quirks;
+    struct quirkdb *quirkdb;
+};
+
+static void headless_worker(void *arg);
+static void headless_run(struct headless_pool *pool, struct headless_job *job,
+                         struct headless_worker_state *state);
+static void headless_exec(struct headless_pool *pool,
+                          struct headless_worker_state *state,
+                          uint64_t cycles);
+static void headless_replay(struct headless_pool *pool,
+                            struct headless_job *job,
+                            struct headless_worker_state *state);
+static int headless_batch_start(struct headless_pool *pool,
+                                struct headless_worker_state *state);
+static void headless_batch_finish(struct headless_pool *pool,
+                                  struct headless_job *job,
+                                  struct headless_worker_state *state);
+static int headless_wav_open(struct headless_pool *pool,
+                             struct headless_job *job,
+                             struct wav_writer *wav);
+static int headless_quirks(struct headless_pool *pool,
+                           const struct chip8_context *ctx);
+static int headless_read_list(const char *filepath, struct romlib *lib);
+
+static void usage(void)
+{
+    printf("Usage: chip8-headless [options] <rom>...\n"
+           "  -c <cycles>   Instructions to run per ROM\n"
+           "  -d <dir>      Run every ROM in a directory\n"
+           "  -f <frames>   60Hz frames to run per ROM (default %d)\n"
+           "  -i <cycles>   Instructions per frame (default %d)\n"
+           "  -j <threads>  Worker threads (default: core count)\n"
+           "  -l <file>     Read ROM paths from a file, one per line\n"
+           "  -m <mode>     interp (default), block, jit or batch\n"
+           "  -n <count>    Machines per ROM in batch mode (default %d),\n"
+           "                each seeded with the seed + its index\n"
+           "  -p <n>        Profile each ROM, listing the n hottest addresses\n"
+           "  -q <profile>  Quirks for every ROM: none (default), chip8,\n"
+           "                schip or xochip\n"
+           "  -Q <file>     Pick each ROM's quirks from a database of\n"
+           "                \"<hash> <profile>\" lines\n"
+           "  -r <file>     Play a recorded session into each ROM at full\n"
+           "                speed and check its final display and memory\n"
+           "  -s <seed>     RND seed for every ROM\n"
+           "  -v            Check the JIT or batch against the interpreter\n"
+           "  -w <dir>      Record each ROM's beeper to <dir>/<rom>.wav,\n"
+           "                machine 0 in batch mode\n",
+           DEFAULT_FRAMES, DEFAULT_CYCLES_PER_FRAME, DEFAULT_MACHINES);
+}
+
+int main(int argc, char **argv)
+{
+    struct headless_pool pool;
+    platform_thread *threads = NULL;
+    struct romlib lib;
+    int thread_count = platform_cpu_count();
+    uint64_t frames = DEFAULT_FRAMES;
+    uint64_t cycles = 0;
+    uint64_t start_time;
+    uint64_t total_time;
+    uint64_t total_cycles = 0;
+    struct replay replay;
+    struct quirkdb quirkdb;
+    int status;
+
+    memset(&pool, 0, sizeof(pool));
+    romlib_init(&lib);
+    pool.cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    pool.machines = DEFAULT_MACHINES;
+    pool.seed = CHIP8_DEFAULT_SEED;
+    pool.quirks = -1;
+    quirkdb_init(&quirkdb);
+
+    for (int arg = 1; arg < argc; ++arg) {
+        const char *opt = argv[arg];
+
+        if (strcmp(opt, "-v") == 0) {
+            pool.verify = 1;
+        } else if (opt[0] == '-' && arg + 1 < argc) {
+            const char *value = argv[++arg];
+
+            switch (opt[1]) {
+            case 'c':
+                cycles = strtoull(value, NULL, 10);
+                break;
+
+            case 'd':
+                if (romlib_add_dir(&lib, value)) {
+                    printf("Failed to read ROM directory %s\n", value);
+                    return 1;
+                }
+                break;
+
+            case 'f':
+                frames = strtoull(value, NULL, 10);
+                break;
+
+            case 'i':
+                pool.cycles_per_frame = strtoull(value, NULL, 10);
+                break;
+
+            case 'j':
+                thread_count = atoi(value);
+                break;
+
+            case 'n':
+                pool.machines = atoi(value);
+                break;
+
+            case 'p':
+                pool.profile_top = atoi(value);
+                break;
+
+            case 'r':
+                if ((status = replay_load(&replay, value)) != REPLAY_OK) {
+                    printf("Failed to load replay %s: %s\n", value,
+                           replay_status_string(status));
+                    return 1;
+                }
+
+                pool.replay = &replay;
+                break;
+
+            case 'q':
+                if ((pool.quirks = chip8_quirks_parse(value)) < 0) {
+                    printf("Unknown quirk profile %s\n", value);
+                    return 1;
+                }
+                break;
+
+            case 'Q':
+                if ((status = quirkdb_load(&quirkdb, value)) != 0) {
+                    if (status < 0) {
+                        printf("Failed to read quirk database %s\n", value);
+                    } else {
+                        printf("%s:%d: expected <hash> <profile>\n", value,
+                               status);
+                    }
+
+                    return 1;
+                }
+
+                pool.quirkdb = &quirkdb;
+                break;
+
+            case 's':
+                pool.seed = strtoull(value, NULL, 0);
+                break;
+
+            case 'w':
+                pool.wav_dir = value;
+                break;
+
+            case 'm':
+                if (strcmp(value, "interp") == 0) {
+                    pool.mode = HEADLESS_INTERP;
+                } else if (strcmp(value, "block") == 0) {
+                    pool.mode = HEADLESS_BLOCK;
+                } else if (strcmp(value, "jit") == 0) {
+                    pool.mode = HEADLESS_JIT;
+                } else if (strcmp(value, "batch") == 0) {
+                    pool.mode = HEADLESS_BATCH;
+                } else {
+                    usage();
+                    return 1;
+                }
+                break;
+
+            case 'l':
+                if (headless_read_list(value, &lib)) {
+                    printf("Failed to read ROM list %s\n", value);
+                    return 1;
+                }
+                break;
+
+            default:
+                usage();
+                return 1;
+            }
+        } else if (opt[0] == '-') {
+            usage();
+            return 1;
+        } else if (!romlib_add(&lib, opt)) {
+            return 1;
+        }
+    }
+
+    if (lib.count == 0 || pool.cycles_per_frame == 0 || pool.machines < 1
+        || (pool.replay && pool.mode == HEADLESS_BATCH)) {
+        usage();
+        return 0;
+    }
+
+#if !CHIP8_PROFILE
+    if (pool.profile_top > 0) {
+        printf("Profiling needs a build with CHIP8_PROFILE=1\n");
+        pool.profile_top = 0;
+    }
+#endif
+
+    pool.cycles = cycles ? cycles : frames * pool.cycles_per_frame;
+    pool.jobs = calloc(lib.count, sizeof(*pool.jobs));
+
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    threads = calloc(thread_count, sizeof(*threads));
+
+    if (!pool.jobs || !threads) {
+        return 1;
+    }
+
+    /* Unusable ROMs are reported once here and not run */
+    for (int r = 0; r < lib.count; ++r) {
+        if (lib.entries[r].status == CHIP8_ROM_OK) {
+            pool.jobs[pool.job_count++].rom = &lib.entries[r];
+        } else {
+            printf("Skipping %s: %s\n", lib.entries[r].path,
+                   chip8_rom_status_string(lib.entries[r].status));
+        }
+    }
+
+    if (thread_count > pool.job_count) {
+        thread_count = pool.job_count;
+    }
+
+    /* The first chip8_init builds tables shared by every context, so it
+     * must not race between workers */
+    struct chip8_context *first = malloc(sizeof(*first));
+
+    if (!first || chip8_init(first)) {
+        return 1;
+    }
+
+    free(first);
+
+    platform_mutex_init(&pool.lock);
+    start_time = platform_time_ns();
+
+    int started = 0;
+
+    for (; started < thread_count; ++started) {
+        if (platform_thread_create(&threads[started], headless_worker, &pool)) {
+            break;
+        }
+    }
+
+    /* Fall back to running on this thread if no worker could start */
+    if (started == 0) {
+        headless_worker(&pool);
+    }
+
+    for (int t = 0; t < started; ++t) {
+        platform_thread_join(&threads[t]);
+    }
+
+    total_time = platform_time_ns() - start_time;
+    platform_mutex_destroy(&pool.lock);
+
+    for (int j = 0; j < pool.job_count; ++j) {
+        struct headless_job *job = &pool.jobs[j];
+
+        printf("%-40s cycles=%llu pc=%03x display=%016llx %.3fms\n",
+               job->rom->path, (unsigned long long)job->cycles, job->pc,
+               (unsigned long long)job->display_hash,
+               job->time_ns / 1000000.0);
+
+        if (job->quirks != CHIP8_QUIRKS_none) {
+            printf("%-40s quirks: %s\n", "", chip8_quirks_name(job->quirks));
+        }
+
+        if (job->fault.type != CHIP8_FAULT_NONE) {
+            printf("%-40s stopped on %s at %03x (%04x)\n", "",
+                   chip8_fault_string(job->fault.type), job->fault.pc,
+                   job->fault.opcode);
+        }
+
+        if (job->wav_failed) {
+            printf("%-40s failed to write the WAV recording\n", "");
+        }
+
+        if (job->batch_failed) {
+            printf("%-40s out of memory for %d machines, not run\n", "",
+                   pool.machines);
+            continue;
+        }
+
+        if (pool.replay) {
+            printf("%-40s replay: %s\n", "",
+                   replay_results[job->replay_result]);
+        }
+
+        if (pool.mode == HEADLESS_BLOCK) {
+            printf("%-40s block cache: %llu hits, %llu misses\n", "",
+                   (unsigned long long)job->cache_hits,
+                   (unsigned long long)job->cache_misses);
+        }
+
+        if (pool.mode == HEADLESS_JIT) {
+            printf("%-40s jit: %llu hits, %llu compiled, %llu mismatches\n",
+                   "", (unsigned long long)job->cache_hits,
+                   (unsigned long long)job->cache_misses,
+                   (unsigned long long)job->mismatches);
+        }
+
+        if (pool.mode == HEADLESS_BATCH) {
+            printf("%-40s batch: %d machines, %llu vector groups, "
+                   "%llu scalar steps, %llu mismatches\n", "", pool.machines,
+                   (unsigned long long)job->vector_steps,
+                   (unsigned long long)job->scalar_steps,
+                   (unsigned long long)job->mismatches);
+        }
+
+        total_cycles += job->cycles;
+    }
+
+    printf("%d ROMs on %d threads, %llu instructions in %.3fs (%.0f IPS)\n",
+           pool.job_count, started ? started : 1,
+           (unsigned long long)total_cycles, total_time / 1e9,
+           total_time ? total_cycles * 1e9 / total_time : 0.0);
+
+    for (int j = 0; j < pool.job_count; ++j) {
+        struct headless_job *job = &pool.jobs[j];
+
+        if (job->profile) {
+            printf("\nProfile of %s: ", job->rom->path);
+            profile_report(stdout, job->profile, job->mem, pool.profile_top,
+                           job->time_ns / 1e9);
+            free(job->profile);
+            free(job->mem);
+        }
+    }
+
+    free(threads);
+    free(pool.jobs);
+    romlib_free(&lib);
+    quirkdb_free(&quirkdb);
+
+    if (pool.replay) {
+        replay_free(pool.replay);
+    }
+
+    return 0;
+}
+
+static void headless_worker(void *arg)
+{
+    struct headless_pool *pool = arg;
+    struct headless_worker_state *state = malloc(sizeof(*state));
+
+    if (!state) {
+        return;
+    }
+
+    for (;;) {
+        int job;
+
+        platform_mutex_lock(&pool->lock);
+        job = pool->next_job < pool->job_count ? pool->next_job++ : -1;
+        platform_mutex_unlock(&pool->lock);
+
+        if (job < 0) {
+            break;
+        }
+
+        headless_run(pool, &pool->jobs[job], state);
+    }
+
+    free(state);
+}
+
+static void headless_run(struct headless_pool *pool, struct headless_job *job,
+                         struct headless_worker_state *state)
+{
+    struct chip8_context *ctx = &state->ctx;
+    uint64_t start_time = platform_time_ns();
+    uint64_t remaining = pool->cycles;
+    struct wav_writer wav;
+    int recording = 0;
+    uint64_t frame_count = 0;
+
+    chip8_init(ctx);
+    romlib_load(job->rom, ctx);
+    chip8_seed(ctx, pool->replay ? pool->replay->header.seed : pool->seed);
+    job->quirks = headless_quirks(pool, ctx);
+    ctx->quirks = (uint8_t)job->quirks;
+
+#if CHIP8_PROFILE
+    if (pool->profile_top > 0) {
+        job->profile = calloc(1, sizeof(*job->profile));
+        ctx->profile = job->profile;
+    }
+#endif
+
+    if (pool->mode == HEADLESS_BLOCK) {
+        bcache_init(&state->cache);
+    }
+
+    if (pool->mode == HEADLESS_JIT) {
+        /* jit_run interprets if the JIT isn't available */
+        jit_init(&state->jit);
+        state->jit.verify = pool->verify;
+    }
+
+    if (pool->mode == HEADLESS_BATCH && headless_batch_start(pool, state)) {
+        job->batch_failed = 1;
+        free(job->profile);
+        job->profile = NULL;
+        return;
+    }
+
+    if (pool->wav_dir) {
+        recording = headless_wav_open(pool, job, &wav) == 0;
+        job->wav_failed = !recording;
+    }
+
+    if (pool->replay) {
+        /* Replaces the fixed run below */
+        headless_replay(pool, job, state);
+        remaining = 0;
+    }
+
+    while (remaining > 0) {
+        uint64_t frame = remaining < pool->cycles_per_frame
+                         ? remaining : pool->cycles_per_frame;
+
+        headless_exec(pool, state, frame);
+
+        if (recording) {
+            /* One 60Hz frame of audio, beeping if the sound timer ran
+             * through it */
+            uint8_t sound_timer = pool->mode == HEADLESS_BATCH
+                                  ? state->batch.sound_timer[0]
+                                  : ctx->sound_timer;
+
+            wav_write(&wav, (uint32_t)((frame_count + 1) * BEEPER_RATE
+                                       / FRAME_HZ
+                                       - frame_count * BEEPER_RATE
+                                       / FRAME_HZ),
+                      sound_timer > 0);
+            ++frame_count;
+        }
+
+        if (pool->mode == HEADLESS_BATCH) {
+            batch_tick_timers(&state->batch);
+        } else {
+            chip8_tick_timers(ctx);
+        }
+
+        remaining -= frame;
+    }
+
+    if (pool->mode == HEADLESS_BLOCK) {
+        job->cache_hits = state->cache.hits;
+        job->cache_misses = state->cache.misses;
+    }
+
+    if (pool->mode == HEADLESS_JIT) {
+        job->cache_hits = state->jit.hits;
+        job->cache_misses = state->jit.compiled;
+        job->mismatches = state->jit.mismatches;
+        jit_cleanup(&state->jit);
+    }
+
+    if (!pool->replay) {
+        job->cycles = pool->cycles;
+    }
+
+    job->time_ns = platform_time_ns() - start_time;
+
+    if (recording && wav_close(&wav)) {
+        job->wav_failed = 1;
+    }
+
+    if (pool->mode == HEADLESS_BATCH) {
+        headless_batch_finish(pool, job, state);
+    }
+
+    job->display_hash = chip8_hash(ctx->display, sizeof(ctx->display));
+    job->pc = ctx->pc;
+
+#if CHIP8_SAFE
+    job->fault = ctx->fault;
+#endif
+
+    if (job->profile) {
+        /* Keep the final memory to disassemble the hot addresses */
+        job->mem = malloc(sizeof(ctx->mem));
+
+        if (job->mem) {
+            memcpy(job->mem, ctx->mem, sizeof(ctx->mem));
+        } else {
+            free(job->profile);
+            job->profile = NULL;
+        }
+    }
+}
+
+static void headless_exec(struct headless_pool *pool,
+                          struct headless_worker_state *state,
+                          uint64_t cycles)
+{
+    /* Runs cycles instructions in the pool's mode */
+    struct chip8_context *ctx = &state->ctx;
+
+    while (cycles > 0) {
+        uint32_t chunk = cycles < UINT32_MAX ? (uint32_t)cycles : UINT32_MAX;
+
+        switch (pool->mode) {
+        case HEADLESS_INTERP:
+            chip8_run(ctx, chunk);
+            break;
+
+        case HEADLESS_BLOCK:
+            bcache_run(&state->cache, ctx, chunk);
+            break;
+
+        case HEADLESS_JIT:
+            jit_run(&state->jit, ctx, chunk);
+            break;
+
+        case HEADLESS_BATCH:
+            batch_run(&state->batch, chunk);
+            break;
+        }
+
+        cycles -= chunk;
+    }
+}
+
+static void headless_replay(struct headless_pool *pool,
+                            struct headless_job *job,
+                            struct headless_worker_state *state)
+{
+    /* Runs the recorded session: the instructions between events, each
+     * key change and timer tick where it happened, then the tail */
+    const struct replay *replay = pool->replay;
+    struct chip8_context *ctx = &state->ctx;
+    uint64_t done = 0;
+    uint64_t delta;
+    uint8_t event;
+    size_t pos = 0;
+
+    /* Neither would replay the same instructions */
+    if (replay->header.variant != CHIP8_VARIANT) {
+        job->replay_result = HEADLESS_REPLAY_WRONG_VARIANT;
+        return;
+    }
+
+    if (chip8_program_hash(ctx) != replay->header.program_hash) {
+        job->replay_result = HEADLESS_REPLAY_WRONG_ROM;
+        return;
+    }
+
+    while (replay_next(replay, &pos, &delta, &event) == 0) {
+        headless_exec(pool, state, delta);
+        replay_apply(ctx, event);
+        done += delta;
+    }
+
+    if (replay->header.cycles > done) {
+        headless_exec(pool, state, replay->header.cycles - done);
+        done = replay->header.cycles;
+    }
+
+    job->cycles = done;
+    job->replay_result =
+        chip8_hash(ctx->display, sizeof(ctx->display))
+            == replay->header.display_hash
+        && chip8_hash(ctx->mem, sizeof(ctx->mem)) == replay->header.mem_hash
+        ? HEADLESS_REPLAY_MATCH : HEADLESS_REPLAY_MISMATCH;
+}
+
+static int headless_batch_start(struct headless_pool *pool,
+                                struct headless_worker_state *state)
+{
+    /* Every machine starts from the loaded ROM with its own seed; returns
+     * 1 if the machines couldn't be allocated */
+    if (batch_init(&state->batch, pool->machines)) {
+        return 1;
+    }
+
+    for (int k = 0; k < pool->machines; ++k) {
+        chip8_seed(&state->ctx, pool->seed + k);
+        batch_load(&state->batch, k, &state->ctx);
+    }
+
+    return 0;
+}
+
+static void headless_batch_finish(struct headless_pool *pool,
+                                  struct headless_job *job,
+                                  struct headless_worker_state *state)
+{
+    /* Machine 0 is reported; with -v every machine is checked against the
+     * same ROM and seed run alone through the interpreter */
+    struct chip8_batch *batch = &state->batch;
+    struct chip8_context *ctx = &state->ctx;
+
+    job->cycles *= pool->machines;
+    job->vector_steps = batch->vector_steps;
+    job->scalar_steps = batch->scalar_steps;
+
+    for (int k = 0; pool->verify && k < pool->machines; ++k) {
+        uint8_t expected[CHIP8_STATE_SIZE];
+        uint8_t actual[CHIP8_STATE_SIZE];
+        uint64_t remaining = pool->cycles;
+
+        chip8_init(ctx);
+        romlib_load(job->rom, ctx);
+        chip8_seed(ctx, pool->seed + k);
+        ctx->quirks = (uint8_t)job->quirks;
+
+        while (remaining > 0) {
+            uint64_t frame = remaining < pool->cycles_per_frame
+                             ? remaining : pool->cycles_per_frame;
+
+            chip8_frame(ctx, (uint32_t)frame);
+            remaining -= frame;
+        }
+
+        batch_store(batch, k, &batch->ctxs[k]);
+        chip8_save_state(ctx, expected, sizeof(expected));
+        chip8_save_state(&batch->ctxs[k], actual, sizeof(actual));
+
+        if (memcmp(expected, actual, sizeof(expected)) != 0) {
+            printf("batch: machine %d of %s diverged from interpreter\n", k,
+                   job->rom->path);
+            job->mismatches++;
+        }
+    }
+
+    batch_store(batch, 0, ctx);
+    batch_free(batch);
+}
+
+static int headless_wav_open(struct headless_pool *pool,
+                             struct headless_job *job,
+                             struct wav_writer *wav)
+{
+    /* <wav_dir>/<ROM file name>.wav */
+    const char *name = job->rom->path;
+    char *path;
+    int failed;
+
+    for (const char *p = job->rom->path; *p; ++p) {
+        if (*p == '/' || *p == '\\') {
+            name = p + 1;
+        }
+    }
+
+    path = malloc(strlen(pool->wav_dir) + strlen(name) + 6);
+
+    if (!path) {
+        return 1;
+    }
+
+    sprintf(path, "%s/%s.wav", pool->wav_dir, name);
+    failed = wav_open(wav, path, BEEPER_RATE);
+    free(path);
+
+    return failed;
+}
+
+static int headless_quirks(struct headless_pool *pool,
+                           const struct chip8_context *ctx)
+{
+    /* A replay runs with the profile it was recorded with, otherwise -q
+     * wins over the database */
+    int quirks;
+
+    if (pool->replay) {
+        return pool->replay->header.quirks;
+    }
+
+    if (pool->quirks >= 0) {
+        return pool->quirks;
+    }
+
+    if (pool->quirkdb
+        && (quirks = quirkdb_lookup(pool->quirkdb,
+                                    chip8_program_hash(ctx))) >= 0) {
+        return quirks;
+    }
+
+    return CHIP8_QUIRKS_none;
+}
+
+static int headless_read_list(const char *filepath, struct romlib *lib)
+{
+    FILE *f = NULL;
+    char line[1024];
+
+    if ((f = fopen(filepath, "r")) == NULL) {
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        size_t len = strcspn(line, "\r\n");
+
+        line[len] = '\0';
+
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+
+        if (!romlib_add(lib, line)) {
+            fclose(f);
+            return 1;
+        }
+    }
+
+    fclose(f);
+
+    return 0;
+}
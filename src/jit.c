@@ -0,0 +1,524 @@
+#include "jit.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+/* Fx55 and Fx33 write at most this many bytes from I */
+#define WRITE_SPAN 16
+
+/* Worst case emitted bytes per instruction, plus prologue/epilogue */
+#define JIT_INSN_MAX 64
+#define JIT_BLOCK_MAX (BCACHE_BLOCK_INSNS * JIT_INSN_MAX + 64)
+
+/* Host register use inside a block:
+ *   rbx  struct chip8_context *
+ *   r12d I
+ * pc is known statically and only stored on exit or before a fallback.
+ *
+ * V0-VF stay in the context and are used as [rbx + disp32] memory
+ * operands. Most blocks contain a fallback call into chip8_exec, which
+ * reads and writes ctx->registers, so V registers held in host registers
+ * would have to be spilled and reloaded around every call as well as at
+ * every exit, and only rbp and r13-r15 are left for sixteen of them.
+ * The operands stay in L1, and x86 folds them into the ALU and compare
+ * instructions, so a mapping would save little. */
+
+#define CTX_OFF(field) ((uint32_t)offsetof(struct chip8_context, field))
+#define REG_OFF(r) (CTX_OFF(registers) + (r))
+
+struct jit_emitter {
+    uint8_t *p;
+};
+
+static struct jit_block *jit_compile(struct jit_context *jit,
+                                     struct chip8_context *ctx);
+static void jit_verify(struct jit_context *jit, struct chip8_context *ctx,
+                       const struct jit_block *block);
+
+#if JIT_SUPPORTED
+
+static void emit8(struct jit_emitter *e, uint8_t b)
+{
+    *e->p++ = b;
+}
+
+static void emit16(struct jit_emitter *e, uint16_t v)
+{
+    memcpy(e->p, &v, sizeof(v));
+    e->p += sizeof(v);
+}
+
+static void emit32(struct jit_emitter *e, uint32_t v)
+{
+    memcpy(e->p, &v, sizeof(v));
+    e->p += sizeof(v);
+}
+
+static void emit64(struct jit_emitter *e, uint64_t v)
+{
+    memcpy(e->p, &v, sizeof(v));
+    e->p += sizeof(v);
+}
+
+/* <op> [rbx + disp32] with a ModRM reg field, e.g. "mov al, [rbx+d]" */
+static void emit_rbx(struct jit_emitter *e, uint8_t op, uint8_t reg,
+                     uint32_t disp)
+{
+    emit8(e, op);
+    emit8(e, 0x80 | (reg << 3) | 3);
+    emit32(e, disp);
+}
+
+static void emit_store_pc(struct jit_emitter *e, uint16_t pc)
+{
+    /* mov word [rbx + pc], imm16 */
+    emit8(e, 0x66);
+    emit_rbx(e, 0xC7, 0, CTX_OFF(pc));
+    emit16(e, pc);
+}
+
+static void emit_store_opcode(struct jit_emitter *e, uint16_t opcode)
+{
+    /* mov word [rbx + opcode], imm16 */
+    emit8(e, 0x66);
+    emit_rbx(e, 0xC7, 0, CTX_OFF(opcode));
+    emit16(e, opcode);
+}
+
+static void emit_store_i(struct jit_emitter *e)
+{
+    /* mov [rbx + i], r12w */
+    emit8(e, 0x66);
+    emit8(e, 0x44);
+    emit_rbx(e, 0x89, 4, CTX_OFF(i));
+}
+
+static void emit_load_i(struct jit_emitter *e)
+{
+    /* movzx r12d, word [rbx + i] */
+    emit8(e, 0x44);
+    emit8(e, 0x0F);
+    emit_rbx(e, 0xB7, 4, CTX_OFF(i));
+}
+
+static void emit_skip_if(struct jit_emitter *e, uint8_t jcc_not_taken,
+                         uint16_t next)
+{
+    /* Flags already set by a compare; pc = next, + 2 if the skip is taken */
+    emit_store_pc(e, next);
+    emit8(e, jcc_not_taken);
+#if CHIP8_VARIANT == CHIP8_VARIANT_XOCHIP
+    emit8(e, 8 + 7 + 2 + 7 + 2 + 8);
+#else
+    emit8(e, 8);
+#endif
+
+    /* add word [rbx + pc], 2 (8 bytes) */
+    emit8(e, 0x66);
+    emit_rbx(e, 0x83, 0, CTX_OFF(pc));
+    emit8(e, 2);
+
+#if CHIP8_VARIANT == CHIP8_VARIANT_XOCHIP
+    /* Another 2 over F000 nnnn, looked at when the skip runs since the
+     * word at next is outside the block. Byte compares, with the second
+     * address wrapped as in CHIP8_SKIP_SIZE: cmp byte [rbx + mem + next],
+     * 0xF0; jne +17; cmp byte [rbx + mem + next + 1], 0; jne +8;
+     * add word [rbx + pc], 2 */
+    emit_rbx(e, 0x80, 7, CTX_OFF(mem) + next);
+    emit8(e, 0xF0);
+    emit8(e, 0x75);
+    emit8(e, 7 + 2 + 8);
+    emit_rbx(e, 0x80, 7, CTX_OFF(mem) + (uint16_t)(next + 1));
+    emit8(e, 0x00);
+    emit8(e, 0x75);
+    emit8(e, 8);
+    emit8(e, 0x66);
+    emit_rbx(e, 0x83, 0, CTX_OFF(pc));
+    emit8(e, 2);
+#endif
+}
+
+static int emit_native(struct jit_emitter *e, const struct chip8_insn *in,
+                       uint16_t next)
+{
+    /* Returns 0 if the instruction has no native translation */
+    switch (in->op) {
+    case CHIP8_OP_0nnn:
+        break;
+
+    case CHIP8_OP_1nnn:
+        emit_store_pc(e, in->nnn);
+        break;
+
+    case CHIP8_OP_3xkk:
+    case CHIP8_OP_4xkk:
+        /* cmp byte [Vx], kk */
+        emit_rbx(e, 0x80, 7, REG_OFF(in->x));
+        emit8(e, in->kk);
+        emit_skip_if(e, in->op == CHIP8_OP_3xkk ? 0x75 : 0x74, next);
+        break;
+
+    case CHIP8_OP_5xy0:
+    case CHIP8_OP_9xy0:
+        /* mov al, [Vx]; cmp al, [Vy] */
+        emit_rbx(e, 0x8A, 0, REG_OFF(in->x));
+        emit_rbx(e, 0x3A, 0, REG_OFF(in->y));
+        emit_skip_if(e, in->op == CHIP8_OP_5xy0 ? 0x75 : 0x74, next);
+        break;
+
+    case CHIP8_OP_6xkk:
+        /* mov byte [Vx], kk */
+        emit_rbx(e, 0xC6, 0, REG_OFF(in->x));
+        emit8(e, in->kk);
+        break;
+
+    case CHIP8_OP_7xkk:
+        /* add byte [Vx], kk */
+        emit_rbx(e, 0x80, 0, REG_OFF(in->x));
+        emit8(e, in->kk);
+        break;
+
+    case CHIP8_OP_8xy0:
+    case CHIP8_OP_8xy1:
+    case CHIP8_OP_8xy2:
+    case CHIP8_OP_8xy3: {
+        /* mov al, [Vy]; mov/or/and/xor [Vx], al */
+        static const uint8_t ops[] = { 0x88, 0x08, 0x20, 0x30 };
+
+        emit_rbx(e, 0x8A, 0, REG_OFF(in->y));
+        emit_rbx(e, ops[in->op - CHIP8_OP_8xy0], 0, REG_OFF(in->x));
+        break;
+    }
+
+    case CHIP8_OP_8xy4:
+        /* mov al, [Vx]; add al, [Vy]; setc cl; mov [VF], cl; mov [Vx], al */
+        emit_rbx(e, 0x8A, 0, REG_OFF(in->x));
+        emit_rbx(e, 0x02, 0, REG_OFF(in->y));
+        emit8(e, 0x0F);
+        emit8(e, 0x92);
+        emit8(e, 0xC1);
+        emit_rbx(e, 0x88, 1, REG_OFF(0xF));
+        emit_rbx(e, 0x88, 0, REG_OFF(in->x));
+        break;
+
+    case CHIP8_OP_Annn:
+        /* mov r12d, nnn */
+        emit8(e, 0x41);
+        emit8(e, 0xBC);
+        emit32(e, in->nnn);
+        break;
+
+    case CHIP8_OP_Fx07:
+        emit_rbx(e, 0x8A, 0, CTX_OFF(delay_timer));
+        emit_rbx(e, 0x88, 0, REG_OFF(in->x));
+        break;
+
+    case CHIP8_OP_Fx15:
+        emit_rbx(e, 0x8A, 0, REG_OFF(in->x));
+        emit_rbx(e, 0x88, 0, CTX_OFF(delay_timer));
+        break;
+
+    case CHIP8_OP_Fx18:
+        emit_rbx(e, 0x8A, 0, REG_OFF(in->x));
+        emit_rbx(e, 0x88, 0, CTX_OFF(sound_timer));
+        break;
+
+    case CHIP8_OP_Fx1E:
+        /* movzx eax, byte [Vx]; add r12w, ax */
+        emit8(e, 0x0F);
+        emit_rbx(e, 0xB6, 0, REG_OFF(in->x));
+        emit8(e, 0x66);
+        emit8(e, 0x41);
+        emit8(e, 0x01);
+        emit8(e, 0xC4);
+        break;
+
+    default:
+        return 0;
+    }
+
+    return 1;
+}
+
+static void emit_fallback(struct jit_emitter *e, const struct chip8_insn *in,
+                          uint16_t addr)
+{
+    /* chip8_exec(ctx, in) with I and pc synced around the call */
+    emit_store_i(e);
+    emit_store_pc(e, addr);
+
+    /* mov rdi, rbx; movabs rsi, in; movabs rax, chip8_exec; call rax */
+    emit8(e, 0x48);
+    emit8(e, 0x89);
+    emit8(e, 0xDF);
+    emit8(e, 0x48);
+    emit8(e, 0xBE);
+    emit64(e, (uint64_t)(uintptr_t)in);
+    emit8(e, 0x48);
+    emit8(e, 0xB8);
+    emit64(e, (uint64_t)(uintptr_t)&chip8_exec);
+    emit8(e, 0xFF);
+    emit8(e, 0xD0);
+
+    emit_load_i(e);
+}
+
+int jit_init(struct jit_context *jit)
+{
+    memset(jit, 0, sizeof(*jit));
+
+    jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (jit->code == MAP_FAILED) {
+        jit->code = NULL;
+        return 1;
+    }
+
+    return 0;
+}
+
+void jit_cleanup(struct jit_context *jit)
+{
+    if (jit->code) {
+        munmap(jit->code, JIT_CODE_SIZE);
+        jit->code = NULL;
+    }
+}
+
+static struct jit_block *jit_compile(struct jit_context *jit,
+                                     struct chip8_context *ctx)
+{
+    struct jit_block *block;
+    struct jit_emitter e;
+    uint32_t addr = ctx->pc;
+    int pc_stored = 0;
+
+    if (jit->used == JIT_BLOCKS
+        || jit->code_used + JIT_BLOCK_MAX > JIT_CODE_SIZE) {
+        jit_flush(jit);
+    }
+
+    /* Code pages are only writable while compiling (W^X) */
+    if (mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+
+    block = &jit->blocks[jit->used++];
+    block->start = ctx->pc;
+    block->count = 0;
+    block->code = (void (*)(struct chip8_context *))(jit->code
+                                                     + jit->code_used);
+
+    e.p = jit->code + jit->code_used;
+
+    /* push rbx; push r12; sub rsp, 8; mov rbx, rdi */
+    emit8(&e, 0x53);
+    emit8(&e, 0x41);
+    emit8(&e, 0x54);
+    emit8(&e, 0x48);
+    emit8(&e, 0x83);
+    emit8(&e, 0xEC);
+    emit8(&e, 0x08);
+    emit8(&e, 0x48);
+    emit8(&e, 0x89);
+    emit8(&e, 0xFB);
+    emit_load_i(&e);
+
+    while (block->count < BCACHE_BLOCK_INSNS && addr < PROGRAM_END) {
+        struct chip8_insn *in = &block->insns[block->count++];
+        uint8_t flags;
+
+        chip8_decode((ctx->mem[addr] << 8u) | ctx->mem[addr + 1], in);
+        flags = chip8_op_flags(in->op);
+
+        /* Native code follows the none profile; the VF reset quirk sends
+         * the logic ops through chip8_exec */
+        if (!((chip8_quirk_flags(ctx->quirks) & CHIP8_QUIRK_VF_RESET)
+              && in->op >= CHIP8_OP_8xy1 && in->op <= CHIP8_OP_8xy3)
+            && emit_native(&e, in, addr + 2)) {
+            pc_stored = flags & CHIP8_OPF_BRANCH;
+        } else {
+            emit_fallback(&e, in, addr);
+            pc_stored = 1;
+        }
+
+        addr += 2;
+
+        if (flags & (CHIP8_OPF_BRANCH | CHIP8_OPF_WRITE)) {
+            break;
+        }
+    }
+
+    /* A fallback sets pc and opcode itself; native code does it here */
+    if (!pc_stored) {
+        emit_store_pc(&e, addr);
+    }
+
+    emit_store_opcode(&e, block->insns[block->count - 1].opcode);
+    emit_store_i(&e);
+
+    /* add rsp, 8; pop r12; pop rbx; ret */
+    emit8(&e, 0x48);
+    emit8(&e, 0x83);
+    emit8(&e, 0xC4);
+    emit8(&e, 0x08);
+    emit8(&e, 0x41);
+    emit8(&e, 0x5C);
+    emit8(&e, 0x5B);
+    emit8(&e, 0xC3);
+
+    jit->code_used = e.p - jit->code;
+    jit->index[block->start] = jit->used;
+    jit->compiled++;
+
+    if (mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        jit->index[block->start] = 0;
+        return NULL;
+    }
+
+    return block;
+}
+
+#else
+
+int jit_init(struct jit_context *jit)
+{
+    memset(jit, 0, sizeof(*jit));
+
+    return 1;
+}
+
+void jit_cleanup(struct jit_context *jit)
+{
+}
+
+static struct jit_block *jit_compile(struct jit_context *jit,
+                                     struct chip8_context *ctx)
+{
+    return NULL;
+}
+
+#endif
+
+void jit_flush(struct jit_context *jit)
+{
+    memset(jit->index, 0, sizeof(jit->index));
+    jit->used = 0;
+    jit->code_used = 0;
+}
+
+void jit_invalidate(struct jit_context *jit, uint32_t addr, uint32_t len)
+{
+    uint32_t first = addr > BCACHE_BLOCK_INSNS * 2
+                     ? addr - BCACHE_BLOCK_INSNS * 2 : 0;
+    uint32_t end = addr + len < RAM_SIZE ? addr + len : RAM_SIZE;
+
+    for (uint32_t start = first; start < end; ++start) {
+        uint16_t slot = jit->index[start];
+
+        if (slot && start + jit->blocks[slot - 1].count * 2u > addr) {
+            jit->index[start] = 0;
+            jit->invalidations++;
+        }
+    }
+}
+
+int jit_run(struct jit_context *jit, struct chip8_context *ctx,
+            uint32_t cycles)
+{
+    int result = 0;
+
+    while (cycles > 0 && ctx->pc < PROGRAM_END) {
+        struct jit_block *block = NULL;
+        uint16_t slot = jit->index[ctx->pc];
+
+        if (slot) {
+            block = &jit->blocks[slot - 1];
+            jit->hits++;
+        } else if (jit->code) {
+            block = jit_compile(jit, ctx);
+        }
+
+        if (!block) {
+            /* No JIT available, interpret */
+            chip8_run(ctx, cycles);
+            break;
+        }
+
+        if (block->count > cycles) {
+            /* Not enough budget left for the whole block */
+            for (uint32_t k = 0; k < cycles; ++k) {
+                chip8_exec(ctx, &block->insns[k]);
+            }
+
+            break;
+        }
+
+        if (jit->verify) {
+            memcpy(&jit->shadow, ctx, sizeof(*ctx));
+        }
+
+        block->code(ctx);
+        cycles -= block->count;
+
+        if (jit->verify) {
+            chip8_run(&jit->shadow, block->count);
+
+            if (memcmp(&jit->shadow, ctx, sizeof(*ctx)) != 0) {
+                jit_verify(jit, ctx, block);
+                result = 1;
+            }
+        }
+
+        if (chip8_op_flags(block->insns[block->count - 1].op)
+            & CHIP8_OPF_WRITE) {
+            /* As in bcache_run */
+            uint32_t back = chip8_quirk_flags(ctx->quirks)
+                            & CHIP8_QUIRK_LOAD_STORE_I ? WRITE_SPAN : 0;
+
+            jit_invalidate(jit, ctx->i > back ? ctx->i - back : 0,
+                           WRITE_SPAN + back);
+        }
+    }
+
+    return result;
+}
+
+static void jit_verify(struct jit_context *jit, struct chip8_context *ctx,
+                       const struct jit_block *block)
+{
+    /* Report where the JIT and interpreter disagree, then carry on from
+     * the interpreter's state */
+    const struct chip8_context *ref = &jit->shadow;
+
+    jit->mismatches++;
+
+    printf("jit: block %03x (%u insns) diverged from interpreter\n",
+           block->start, block->count);
+
+    if (ref->pc != ctx->pc) {
+        printf("  pc %03x, expected %03x\n", ctx->pc, ref->pc);
+    }
+
+    if (ref->i != ctx->i) {
+        printf("  I %03x, expected %03x\n", ctx->i, ref->i);
+    }
+
+    if (ref->opcode != ctx->opcode) {
+        printf("  opcode %04x, expected %04x\n", ctx->opcode, ref->opcode);
+    }
+
+    for (int r = 0; r < 16; ++r) {
+        if (ref->registers[r] != ctx->registers[r]) {
+            printf("  V%X %02x, expected %02x\n", r, ctx->registers[r],
+                   ref->registers[r]);
+        }
+    }
+
+    memcpy(ctx, ref, sizeof(*ctx));
+}
@@ -0,0 +1,59 @@
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+
+#include "chip8.h"
+#include "bcache.h"
+
+#include <stddef.h>
+
+/* x86-64 JIT: basic blocks (same boundaries as bcache) are compiled to
+ * native code. ALU, load and compare-skip instructions are emitted
+ * inline; everything else calls back into chip8_exec. */
+
+/* Off in CHIP8_SAFE builds: inline code after a faulting fallback call
+ * would still run */
+#if defined(__x86_64__) && !defined(_WIN32) && !CHIP8_SAFE
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#define JIT_BLOCKS 512
+#define JIT_CODE_SIZE (1024 * 1024)
+
+struct jit_block {
+    void (*code)(struct chip8_context *ctx);
+    uint16_t start;
+    uint16_t count;
+
+    /* Kept for the fallback calls and partial blocks */
+    struct chip8_insn insns[BCACHE_BLOCK_INSNS];
+};
+
+struct jit_context {
+    uint16_t index[RAM_SIZE];
+    uint16_t used;
+
+    uint8_t *code;
+    size_t code_used;
+
+    /* Lockstep check against the interpreter after every block */
+    int verify;
+    struct chip8_context shadow;
+
+    uint64_t hits;
+    uint64_t compiled;
+    uint64_t invalidations;
+    uint64_t mismatches;
+
+    struct jit_block blocks[JIT_BLOCKS];
+};
+
+int jit_init(struct jit_context *jit);
+void jit_cleanup(struct jit_context *jit);
+void jit_flush(struct jit_context *jit);
+void jit_invalidate(struct jit_context *jit, uint32_t addr, uint32_t len);
+int jit_run(struct jit_context *jit, struct chip8_context *ctx,
+            uint32_t cycles);
+
+#endif
@@ -0,0 +1,61 @@
+#include "latency.h"
+
+void latency_add(struct latency_histogram *h, uint64_t us)
+{
+    uint64_t bucket = us / LATENCY_BUCKET_US;
+
+    if (bucket < LATENCY_BUCKETS) {
+        h->buckets[bucket]++;
+    } else {
+        h->over++;
+    }
+
+    if (us > h->max_us) {
+        h->max_us = us;
+    }
+
+    h->count++;
+}
+
+uint64_t latency_percentile(const struct latency_histogram *h,
+                            double percent)
+{
+    /* Upper edge of the bucket holding the given percentile, or max_us if
+     * it falls past the last bucket */
+    uint64_t rank = (uint64_t)(h->count * percent / 100.0);
+    uint64_t seen = 0;
+
+    for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+        seen += h->buckets[b];
+
+        if (seen > rank) {
+            return (uint64_t)(b + 1) * LATENCY_BUCKET_US;
+        }
+    }
+
+    return h->max_us;
+}
+
+void latency_report(FILE *f, const char *name,
+                    const struct latency_histogram *h)
+{
+    if (h->count == 0) {
+        fprintf(f, "%s: no samples\n", name);
+        return;
+    }
+
+    fprintf(f, "%s: %llu samples, p50 %.1fms p95 %.1fms p99 %.1fms "
+            "max %.1fms",
+            name, (unsigned long long)h->count,
+            latency_percentile(h, 50.0) / 1000.0,
+            latency_percentile(h, 95.0) / 1000.0,
+            latency_percentile(h, 99.0) / 1000.0,
+            h->max_us / 1000.0);
+
+    if (h->over) {
+        fprintf(f, ", %u over %dms", h->over,
+                LATENCY_BUCKETS * LATENCY_BUCKET_US / 1000);
+    }
+
+    fprintf(f, "\n");
+}
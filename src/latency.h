@@ -0,0 +1,26 @@
+#ifndef CHIP8_LATENCY_H
+#define CHIP8_LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Fixed-bucket latency histogram in microseconds. Samples past the last
+ * bucket are only counted, and reported as "over". */
+
+#define LATENCY_BUCKET_US 100
+#define LATENCY_BUCKETS 2000
+
+struct latency_histogram {
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t over;
+    uint64_t count;
+    uint64_t max_us;
+};
+
+void latency_add(struct latency_histogram *h, uint64_t us);
+uint64_t latency_percentile(const struct latency_histogram *h,
+                            double percent);
+void latency_report(FILE *f, const char *name,
+                    const struct latency_histogram *h);
+
+#endif
@@ -1,10 +1,161 @@
 #include "sdl.h"
+#include "audio.h"
 #include "chip8.h"
+#include "latency.h"
+#include "profile.h"
+#include "quirkdb.h"
+#include "replay.h"
+#include "rewind.h"
+#include "timing.h"
+
+#include <stdlib.h>
+
+#define DEFAULT_CPU_HZ 600
+#define FRAME_HZ 60
+
+/* Instructions run per batch while unthrottled, between checks of the clock */
+#define UNTHROTTLED_BATCH 1000
+
+#define PROFILE_TOP 20
+
+/* Longest the SDL thread sleeps waiting for an event or a frame */
+#define EVENT_WAIT_MS 100
+
+/* Key events read by the core but not yet on screen; more are dropped */
+#define PRESENT_PENDING 64
+
+struct frame_stats {
+    Uint64 cpu_ticks;
+    Uint64 cpu_ticks_max;
+    Uint64 cycles;
+    Uint32 frames;
+};
+
+/* Everything the emulation thread owns, plus the queues shared with the SDL
+ * thread */
+struct emu_state {
+    struct chip8_context *cpu_ctx;
+    struct input_queue input;
+    struct frame_queue frames;
+    SDL_atomic_t quit;
+
+    /* SDL event pushed with every published frame to wake the SDL thread,
+     * or (Uint32)-1 if none could be registered */
+    Uint32 frame_event;
+
+    Uint64 cpu_hz;
+    int unthrottled;
+    Uint64 frame_count;
+
+    /* Instructions run so far, the time base of recordings */
+    Uint64 cycle;
+
+    /* NULL unless recording */
+    struct replay_recorder *recorder;
+
+    /* NULL when muted or no device could be opened */
+    struct audio_context *audio;
+
+    struct rewind_buffer rewind;
+    int rewind_enabled;
+    int rewinding;
+
+    /* Whether the checked core's current fault has been reported */
+    int faulted;
+
+    /* display_gen of the last published frame */
+    uint32_t published_gen;
+
+    /* Event time of each key's latest change the core hasn't read yet */
+    Uint64 key_time[0xF + 1];
+    uint16_t key_pending;
+
+    /* Event times of key changes the core has read, for the frames */
+    uint32_t input_seq;
+    Uint64 input_time[FRAME_INPUTS];
+
+    /* From the key event to the instruction that tested the key */
+    struct latency_histogram read_latency;
+
+    struct frame_stats stats;
+};
+
+/* SDL thread side: key events from the frames, waiting for a present */
+struct present_latency {
+    uint32_t seen_seq;
+    int pending;
+    Uint64 pending_time[PRESENT_PENDING];
+
+    /* From the key event to the first present after the core read it */
+    struct latency_histogram histogram;
+};
+
+static int emu_thread(void *arg);
+static void emu_frame(struct emu_state *emu);
+static void emu_input(struct emu_state *emu);
+static void emu_observe(struct emu_state *emu);
+static void emu_publish(struct emu_state *emu);
+static void present_latency_frame(struct present_latency *latency,
+                                  const struct frame *frame);
+static void present_latency_presented(struct present_latency *latency);
+static uint64_t ticks_to_us(Uint64 ticks);
+static void frame_stats_report(struct frame_stats *stats);
 
 int main(int argc, char **argv)
 {
-    if (argc < 2) {
-        printf("Usage: <chip8 rom path>\n");
+    const char *rom = NULL;
+    Uint64 cpu_hz = DEFAULT_CPU_HZ;
+    Uint64 seed = 0;
+    int seeded = 0;
+    int unthrottled = 0;
+    Uint32 rewind_seconds = REWIND_DEFAULT_FRAMES / FRAME_HZ;
+    size_t rewind_capacity = REWIND_DEFAULT_CAPACITY;
+    int audio_samples = AUDIO_DEFAULT_SAMPLES;
+    int muted = 0;
+    const char *record_path = NULL;
+    const char *quirkdb_path = NULL;
+    int quirks = -1;
+
+    for (int arg = 1; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "-hz") == 0 && arg + 1 < argc) {
+            cpu_hz = strtoull(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "-seed") == 0 && arg + 1 < argc) {
+            seed = strtoull(argv[++arg], NULL, 0);
+            seeded = 1;
+        } else if (strcmp(argv[arg], "-rewind") == 0 && arg + 1 < argc) {
+            rewind_seconds = (Uint32)strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "-rewind-mb") == 0 && arg + 1 < argc) {
+            rewind_capacity = (size_t)strtoul(argv[++arg], NULL, 10) << 20;
+        } else if (strcmp(argv[arg], "-audio-samples") == 0
+                   && arg + 1 < argc) {
+            audio_samples = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-record") == 0 && arg + 1 < argc) {
+            record_path = argv[++arg];
+        } else if (strcmp(argv[arg], "-quirks") == 0 && arg + 1 < argc) {
+            if ((quirks = chip8_quirks_parse(argv[++arg])) < 0) {
+                printf("Unknown quirk profile %s\n", argv[arg]);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "-quirks-db") == 0 && arg + 1 < argc) {
+            quirkdb_path = argv[++arg];
+        } else if (strcmp(argv[arg], "-mute") == 0) {
+            muted = 1;
+        } else if (strcmp(argv[arg], "-u") == 0) {
+            unthrottled = 1;
+        } else {
+            rom = argv[arg];
+        }
+    }
+
+    if (!rom || (!unthrottled && cpu_hz == 0) || audio_samples < 1
+        || audio_samples > 0xFFFF) {
+        printf("Usage: [-hz <instructions per second> | -u] [-seed <n>] "
+               "[-rewind <seconds>] [-rewind-mb <MB>]\n"
+               "       [-audio-samples <buffer length> | -mute] "
+               "[-record <replay file>]\n"
+               "       [-quirks none|chip8|schip|xochip] "
+               "[-quirks-db <file>] <chip8 rom path>\n"
+               "Hold backspace to rewind\n");
         return 0;
     }
 
@@ -12,49 +163,450 @@ int main(int argc, char **argv)
 
     struct sdl_context sdl_ctx;
     struct chip8_context cpu_ctx;
-    Uint64 current_time;
-    Uint64 chip8_timer;
-    Uint64 chip8_timer_freq = 1000 / 60;
+    struct emu_state *emu;
+    struct present_latency present_latency;
+    struct audio_context audio;
+    struct replay_recorder recorder;
+    SDL_Thread *thread;
 
     if (sdl_init(&sdl_ctx)) {
         return 1;
     }
 
-    if (chip8_init(&cpu_ctx)) {
+    /* Rewind history and queues; too big to want on the stack */
+    if ((emu = calloc(1, sizeof(*emu))) == NULL
+        || chip8_init(&cpu_ctx)) {
+        free(emu);
+        sdl_cleanup(&sdl_ctx);
+        return 1;
+    }
+
+    printf("Loading %s\n", rom);
+    int status = chip8_loadrom(&cpu_ctx, rom);
+
+    if (status != CHIP8_ROM_OK) {
+        printf("Failed to load %s: %s\n", rom,
+               chip8_rom_status_string(status));
+        free(emu);
         sdl_cleanup(&sdl_ctx);
         return 1;
     }
 
-    printf("Loading %s\n", argv[1]);
-    chip8_loadrom(&cpu_ctx, argv[1]);
+    /* -quirks, else the ROM's entry in the database, else none */
+    if (quirks < 0 && quirkdb_path) {
+        struct quirkdb db;
+        int db_status;
+
+        quirkdb_init(&db);
+
+        if ((db_status = quirkdb_load(&db, quirkdb_path)) == 0) {
+            quirks = quirkdb_lookup(&db, chip8_program_hash(&cpu_ctx));
+        } else if (db_status < 0) {
+            printf("Failed to read quirk database %s\n", quirkdb_path);
+        } else {
+            printf("%s:%d: expected <hash> <profile>\n", quirkdb_path,
+                   db_status);
+        }
+
+        quirkdb_free(&db);
+    }
+
+    cpu_ctx.quirks = (uint8_t)(quirks >= 0 ? quirks : CHIP8_QUIRKS_none);
+    printf("ROM hash %016llx, quirks: %s\n",
+           (unsigned long long)chip8_program_hash(&cpu_ctx),
+           chip8_quirks_name(cpu_ctx.quirks));
+
+    /* Fresh randomness each run unless a seed is given for replay */
+    chip8_seed(&cpu_ctx, seeded ? seed : SDL_GetPerformanceCounter());
+
+    emu->cpu_ctx = &cpu_ctx;
+    emu->cpu_hz = cpu_hz;
+    emu->unthrottled = unthrottled;
+    emu->published_gen = cpu_ctx.display_gen;
+    emu->frame_event = SDL_RegisterEvents(1);
+    input_queue_init(&emu->input);
+    frame_queue_init(&emu->frames);
+    memset(&present_latency, 0, sizeof(present_latency));
+
+    if (!muted) {
+        if (audio_init(&audio, (Uint16)audio_samples) == 0) {
+            emu->audio = &audio;
+        } else {
+            printf("No audio: %s\n", SDL_GetError());
+        }
+    }
+
+    if (record_path) {
+        if (replay_record_open(&recorder, record_path, &cpu_ctx)) {
+            printf("Failed to create %s\n", record_path);
+            free(emu);
+            sdl_cleanup(&sdl_ctx);
+            return 1;
+        }
+
+        /* A recording has to be one unbroken run of the machine */
+        printf("Recording to %s, rewind is off\n", record_path);
+        emu->recorder = &recorder;
+        rewind_seconds = 0;
+    }
+
+    if (rewind_seconds > 0 && rewind_capacity > 0) {
+        emu->rewind_enabled = rewind_init(&emu->rewind,
+                                          rewind_seconds * FRAME_HZ,
+                                          rewind_capacity,
+                                          REWIND_DEFAULT_KEYFRAME_INTERVAL)
+                              == 0;
+    }
+
+#if CHIP8_PROFILE
+    Uint64 profile_start = SDL_GetPerformanceCounter();
+
+    cpu_ctx.profile = calloc(1, sizeof(*cpu_ctx.profile));
+#endif
+
+    thread = SDL_CreateThread(emu_thread, "chip8", emu);
+
+    if (!thread) {
+        printf("Failed to start the emulation thread: %s\n", SDL_GetError());
+        running = 0;
+    } else {
+        running = 1;
+    }
 
-    running = 1;
+    /* The emulation runs on its own thread, so a slow present or a window
+     * drag here only delays what's shown, never the machine */
     while (running) {
-        if (sdl_update(&sdl_ctx, &cpu_ctx)) {
+        const struct frame *frame;
+
+        if (sdl_update(&sdl_ctx, &emu->input)) {
             running = 0;
         }
 
-        /* Update 60Hz timers */
-        current_time = SDL_GetTicks64();
-        
-        if (current_time - chip8_timer >= chip8_timer_freq) {
-            if (cpu_ctx.delay_timer > 0) {
-                cpu_ctx.delay_timer--;
-            }
+        frame = frame_queue_acquire(&emu->frames);
 
-            if (cpu_ctx.sound_timer > 0) {
-                /* TODO: Play sound */
-                cpu_ctx.sound_timer--;
-            }
+        if (frame) {
+            present_latency_frame(&present_latency, frame);
+        }
 
-            chip8_timer = current_time;
+        if (frame || sdl_ctx.redraw) {
+            if (sdl_render(&sdl_ctx, frame)) {
+                present_latency_presented(&present_latency);
+            }
+        } else if (emu->frame_event != (Uint32)-1) {
+            /* Idle until input or the next frame's wake-up event */
+            SDL_WaitEventTimeout(NULL, EVENT_WAIT_MS);
+        } else {
+            SDL_Delay(1);
         }
+    }
 
-        chip8_cycle(&cpu_ctx);
-        sdl_render(&sdl_ctx, cpu_ctx.display);
+    if (thread) {
+        SDL_AtomicSet(&emu->quit, 1);
+        SDL_WaitThread(thread, NULL);
+    }
+
+    if (emu->audio) {
+        audio_cleanup(&audio);
+        audio_report(stdout, &audio);
+    }
+
+    if (emu->recorder) {
+        if (replay_record_close(&recorder, emu->cycle, &cpu_ctx)) {
+            printf("Failed to write %s\n", record_path);
+        } else {
+            printf("Recorded %llu instructions to %s\n",
+                   (unsigned long long)emu->cycle, record_path);
+        }
     }
 
     sdl_cleanup(&sdl_ctx);
 
+    latency_report(stdout, "key to read", &emu->read_latency);
+    latency_report(stdout, "key to present", &present_latency.histogram);
+
+    if (emu->rewind_enabled) {
+        rewind_cleanup(&emu->rewind);
+    }
+
+    free(emu);
+
+#if CHIP8_PROFILE
+    if (cpu_ctx.profile) {
+        profile_report(stdout, cpu_ctx.profile, cpu_ctx.mem, PROFILE_TOP,
+                       (double)(SDL_GetPerformanceCounter() - profile_start)
+                       / SDL_GetPerformanceFrequency());
+        free(cpu_ctx.profile);
+    }
+#endif
+
+    return 0;
+}
+
+static int emu_thread(void *arg)
+{
+    struct emu_state *emu = arg;
+    struct chip8_context *cpu_ctx = emu->cpu_ctx;
+    struct frame_stats *stats = &emu->stats;
+    struct frame_clock clock;
+
+    memset(stats, 0, sizeof(*stats));
+    cpu_ctx->keys_read = 0;
+    frame_clock_init(&clock, FRAME_HZ);
+
+    while (!SDL_AtomicGet(&emu->quit)) {
+        Uint32 steps;
+
+        emu_input(emu);
+
+        if (emu->unthrottled && !emu->rewinding) {
+            Uint64 start = SDL_GetPerformanceCounter();
+
+            for (int c = 0; c < UNTHROTTLED_BATCH; ++c) {
+                chip8_cycle(cpu_ctx);
+            }
+
+            stats->cpu_ticks += SDL_GetPerformanceCounter() - start;
+            stats->cycles += UNTHROTTLED_BATCH;
+            emu->cycle += UNTHROTTLED_BATCH;
+
+            emu_observe(emu);
+        }
+
+        /* Whole 60Hz frames due; catches up after a slow frame */
+        steps = frame_clock_advance(&clock);
+
+        if (steps == 0) {
+            /* Ahead of schedule, so sleep rather than spin */
+            if (!emu->unthrottled) {
+                frame_clock_sleep(&clock);
+            }
+
+            continue;
+        }
+
+        while (steps-- > 0) {
+            emu_frame(emu);
+        }
+
+        /* The beep sounds while the sound timer runs */
+        if (emu->audio) {
+            audio_set_beep(emu->audio,
+                           cpu_ctx->sound_timer > 0 && !emu->rewinding);
+        }
+
+        emu_publish(emu);
+    }
+
     return 0;
 }
+
+static void emu_frame(struct emu_state *emu)
+{
+    /* One 60Hz frame: instructions, timers and rewind history */
+    struct chip8_context *cpu_ctx = emu->cpu_ctx;
+    struct frame_stats *stats = &emu->stats;
+
+    if (emu->rewinding) {
+        if (emu->rewind_enabled) {
+            /* Step back a frame, keeping the keys as held now */
+            Uint8 keys[sizeof(cpu_ctx->keys)];
+
+            memcpy(keys, cpu_ctx->keys, sizeof(keys));
+            rewind_pop(&emu->rewind, cpu_ctx);
+            memcpy(cpu_ctx->keys, keys, sizeof(keys));
+        }
+    } else if (emu->unthrottled) {
+        chip8_tick_timers(cpu_ctx);
+
+        if (emu->recorder) {
+            replay_record_tick(emu->recorder, emu->cycle);
+        }
+    } else {
+        /* Spread cpu_hz over the frames without losing remainders */
+        Uint64 frame_count = emu->frame_count;
+        Uint32 cycles = (Uint32)((frame_count + 1) * emu->cpu_hz / FRAME_HZ
+                                 - frame_count * emu->cpu_hz / FRAME_HZ);
+        Uint64 start = SDL_GetPerformanceCounter();
+        Uint64 elapsed;
+
+        chip8_frame(cpu_ctx, cycles);
+
+        elapsed = SDL_GetPerformanceCounter() - start;
+        emu_observe(emu);
+        stats->cpu_ticks += elapsed;
+        stats->cycles += cycles;
+        emu->cycle += cycles;
+
+        /* chip8_frame ticks the timers after the instructions */
+        if (emu->recorder) {
+            replay_record_tick(emu->recorder, emu->cycle);
+        }
+
+        if (elapsed > stats->cpu_ticks_max) {
+            stats->cpu_ticks_max = elapsed;
+        }
+    }
+
+    if (emu->rewind_enabled && !emu->rewinding) {
+        rewind_push(&emu->rewind, cpu_ctx);
+    }
+
+#if CHIP8_SAFE
+    /* Once per fault; rewinding past it clears it */
+    if ((cpu_ctx->fault.type != CHIP8_FAULT_NONE) != emu->faulted) {
+        emu->faulted = !emu->faulted;
+
+        if (emu->faulted) {
+            printf("Stopped on %s at %03X (%04X)\n",
+                   chip8_fault_string(cpu_ctx->fault.type),
+                   cpu_ctx->fault.pc, cpu_ctx->fault.opcode);
+        }
+    }
+#endif
+
+    ++emu->frame_count;
+
+    if (++stats->frames == FRAME_HZ) {
+        frame_stats_report(stats);
+    }
+}
+
+static void emu_input(struct emu_state *emu)
+{
+    /* Apply key changes queued by the SDL thread */
+    struct input_event event;
+
+    while (input_queue_pop(&emu->input, &event) == 0) {
+        switch (event.type) {
+        case INPUT_KEY_DOWN:
+        case INPUT_KEY_UP:
+            emu->cpu_ctx->keys[event.key] = event.type == INPUT_KEY_DOWN;
+            emu->key_time[event.key] = event.time;
+            emu->key_pending |= 1u << event.key;
+
+            if (emu->recorder) {
+                replay_record_key(emu->recorder, emu->cycle, event.key,
+                                  event.type == INPUT_KEY_DOWN);
+            }
+            break;
+
+        case INPUT_REWIND_DOWN:
+            emu->rewinding = 1;
+            break;
+
+        case INPUT_REWIND_UP:
+            emu->rewinding = 0;
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+static void emu_observe(struct emu_state *emu)
+{
+    /* Time the key changes the instructions just run have seen. This is
+     * per batch of instructions rather than per instruction, which is
+     * microseconds early at most. */
+    uint16_t read = emu->cpu_ctx->keys_read & emu->key_pending;
+    Uint64 now;
+
+    emu->cpu_ctx->keys_read = 0;
+
+    if (!read) {
+        return;
+    }
+
+    now = SDL_GetPerformanceCounter();
+
+    for (int key = 0; key < 0xF + 1; ++key) {
+        if (read & (1u << key)) {
+            latency_add(&emu->read_latency,
+                        ticks_to_us(now - emu->key_time[key]));
+            emu->input_time[emu->input_seq % FRAME_INPUTS] =
+                emu->key_time[key];
+            emu->input_seq++;
+        }
+    }
+
+    emu->key_pending &= ~read;
+}
+
+static void emu_publish(struct emu_state *emu)
+{
+    /* Hand the display to the SDL thread if it changed */
+    struct chip8_context *cpu_ctx = emu->cpu_ctx;
+    struct frame *frame;
+
+    if (cpu_ctx->display_gen == emu->published_gen) {
+        return;
+    }
+
+    frame = frame_queue_back(&emu->frames);
+    memcpy(frame->display, cpu_ctx->display, sizeof(frame->display));
+    frame->input_seq = emu->input_seq;
+    memcpy(frame->input_time, emu->input_time, sizeof(frame->input_time));
+    frame_queue_publish(&emu->frames);
+
+    if (emu->frame_event != (Uint32)-1) {
+        SDL_Event event;
+
+        memset(&event, 0, sizeof(event));
+        event.type = emu->frame_event;
+        SDL_PushEvent(&event);
+    }
+
+    chip8_display_clean(cpu_ctx);
+    emu->published_gen = cpu_ctx->display_gen;
+}
+
+static void present_latency_frame(struct present_latency *latency,
+                                  const struct frame *frame)
+{
+    /* Collect the key reads this frame is the first to carry */
+    uint32_t n = latency->seen_seq;
+
+    if (frame->input_seq - n > FRAME_INPUTS) {
+        /* Missed some in skipped frames */
+        n = frame->input_seq - FRAME_INPUTS;
+    }
+
+    for (; n != frame->input_seq; ++n) {
+        if (latency->pending < PRESENT_PENDING) {
+            latency->pending_time[latency->pending++] =
+                frame->input_time[n % FRAME_INPUTS];
+        }
+    }
+
+    latency->seen_seq = frame->input_seq;
+}
+
+static void present_latency_presented(struct present_latency *latency)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    for (int p = 0; p < latency->pending; ++p) {
+        latency_add(&latency->histogram,
+                    ticks_to_us(now - latency->pending_time[p]));
+    }
+
+    latency->pending = 0;
+}
+
+static uint64_t ticks_to_us(Uint64 ticks)
+{
+    return ticks * 1000000 / SDL_GetPerformanceFrequency();
+}
+
+static void frame_stats_report(struct frame_stats *stats)
+{
+    double us_per_tick = 1e6 / (double)SDL_GetPerformanceFrequency();
+
+    printf("frame cpu: avg %.1fus max %.1fus, %llu instructions/frame\n",
+           stats->cpu_ticks * us_per_tick / stats->frames,
+           stats->cpu_ticks_max * us_per_tick,
+           (unsigned long long)(stats->cycles / stats->frames));
+
+    memset(stats, 0, sizeof(*stats));
+}
@@ -0,0 +1,326 @@
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+struct platform_thread_start {
+    platform_thread_func func;
+    void *arg;
+};
+
+#ifdef _WIN32
+
+static DWORD WINAPI platform_thread_entry(LPVOID param)
+{
+    struct platform_thread_start start = *(struct platform_thread_start *)param;
+
+    free(param);
+    start.func(start.arg);
+
+    return 0;
+}
+
+int platform_thread_create(platform_thread *thread,
+                           platform_thread_func func, void *arg)
+{
+    struct platform_thread_start *start = malloc(sizeof(*start));
+
+    if (!start) {
+        return 1;
+    }
+
+    start->func = func;
+    start->arg = arg;
+
+    *thread = CreateThread(NULL, 0, platform_thread_entry, start, 0, NULL);
+
+    if (!*thread) {
+        free(start);
+        return 1;
+    }
+
+    return 0;
+}
+
+void platform_thread_join(platform_thread *thread)
+{
+    WaitForSingleObject(*thread, INFINITE);
+    CloseHandle(*thread);
+}
+
+void platform_mutex_init(platform_mutex *mutex)
+{
+    InitializeCriticalSection(mutex);
+}
+
+void platform_mutex_destroy(platform_mutex *mutex)
+{
+    DeleteCriticalSection(mutex);
+}
+
+void platform_mutex_lock(platform_mutex *mutex)
+{
+    EnterCriticalSection(mutex);
+}
+
+void platform_mutex_unlock(platform_mutex *mutex)
+{
+    LeaveCriticalSection(mutex);
+}
+
+int platform_cpu_count(void)
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+uint64_t platform_time_ns(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+
+    QueryPerformanceCounter(&now);
+
+    /* Split to avoid overflowing the multiply */
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000u
+           + (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000u
+           / freq.QuadPart;
+}
+
+int platform_map_file(const char *path, const uint8_t **data, size_t *size)
+{
+    /* No mapping here: the file is read once into a private copy */
+    HANDLE file;
+    LARGE_INTEGER file_size;
+    uint8_t *buffer;
+    DWORD bytes_read;
+
+    *data = NULL;
+    *size = 0;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    if (!GetFileSizeEx(file, &file_size) || file_size.HighPart != 0) {
+        CloseHandle(file);
+        return 1;
+    }
+
+    if (file_size.LowPart == 0) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    if ((buffer = malloc(file_size.LowPart)) == NULL) {
+        CloseHandle(file);
+        return 1;
+    }
+
+    if (!ReadFile(file, buffer, file_size.LowPart, &bytes_read, NULL)
+        || bytes_read != file_size.LowPart) {
+        free(buffer);
+        CloseHandle(file);
+        return 1;
+    }
+
+    CloseHandle(file);
+
+    *data = buffer;
+    *size = file_size.LowPart;
+
+    return 0;
+}
+
+void platform_unmap_file(const uint8_t *data, size_t size)
+{
+    free((void *)data);
+}
+
+int platform_list_dir(const char *dir, platform_dir_func func, void *arg)
+{
+    WIN32_FIND_DATAA find;
+    HANDLE handle;
+    char path[MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s\\*", dir);
+
+    if ((handle = FindFirstFileA(path, &find)) == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    do {
+        if (!(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            snprintf(path, sizeof(path), "%s\\%s", dir, find.cFileName);
+            func(path, arg);
+        }
+    } while (FindNextFileA(handle, &find));
+
+    FindClose(handle);
+
+    return 0;
+}
+
+#else
+
+static void *platform_thread_entry(void *param)
+{
+    struct platform_thread_start start = *(struct platform_thread_start *)param;
+
+    free(param);
+    start.func(start.arg);
+
+    return NULL;
+}
+
+int platform_thread_create(platform_thread *thread,
+                           platform_thread_func func, void *arg)
+{
+    struct platform_thread_start *start = malloc(sizeof(*start));
+
+    if (!start) {
+        return 1;
+    }
+
+    start->func = func;
+    start->arg = arg;
+
+    if (pthread_create(thread, NULL, platform_thread_entry, start) != 0) {
+        free(start);
+        return 1;
+    }
+
+    return 0;
+}
+
+void platform_thread_join(platform_thread *thread)
+{
+    pthread_join(*thread, NULL);
+}
+
+void platform_mutex_init(platform_mutex *mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+void platform_mutex_destroy(platform_mutex *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+void platform_mutex_lock(platform_mutex *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+void platform_mutex_unlock(platform_mutex *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+int platform_cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (int)count : 1;
+}
+
+uint64_t platform_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int platform_map_file(const char *path, const uint8_t **data, size_t *size)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    *data = NULL;
+    *size = 0;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return 1;
+    }
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return 1;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    /* The mapping stays valid after the descriptor is closed */
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return 1;
+    }
+
+    *data = map;
+    *size = (size_t)st.st_size;
+
+    return 0;
+}
+
+void platform_unmap_file(const uint8_t *data, size_t size)
+{
+    if (data) {
+        munmap((void *)data, size);
+    }
+}
+
+int platform_list_dir(const char *dir, platform_dir_func func, void *arg)
+{
+    DIR *handle;
+    struct dirent *entry;
+
+    if ((handle = opendir(dir)) == NULL) {
+        return 1;
+    }
+
+    while ((entry = readdir(handle)) != NULL) {
+        struct stat st;
+        char path[4096];
+
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            func(path, arg);
+        }
+    }
+
+    closedir(handle);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef CHIP8_PLATFORM_H
+#define CHIP8_PLATFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Minimal OS layer for the frontends that don't use SDL */
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE platform_thread;
+typedef CRITICAL_SECTION platform_mutex;
+#else
+#include <pthread.h>
+
+typedef pthread_t platform_thread;
+typedef pthread_mutex_t platform_mutex;
+#endif
+
+typedef void (*platform_thread_func)(void *arg);
+typedef void (*platform_dir_func)(const char *path, void *arg);
+
+int platform_thread_create(platform_thread *thread,
+                           platform_thread_func func, void *arg);
+void platform_thread_join(platform_thread *thread);
+
+void platform_mutex_init(platform_mutex *mutex);
+void platform_mutex_destroy(platform_mutex *mutex);
+void platform_mutex_lock(platform_mutex *mutex);
+void platform_mutex_unlock(platform_mutex *mutex);
+
+int platform_cpu_count(void);
+
+/* Monotonic clock in nanoseconds */
+uint64_t platform_time_ns(void);
+
+/* Read-only view of a whole file, mapped where the OS allows and read into
+ * memory otherwise. An empty file gives data = NULL, size = 0. */
+int platform_map_file(const char *path, const uint8_t **data, size_t *size);
+void platform_unmap_file(const uint8_t *data, size_t size);
+
+/* Calls func with the path of each regular file in dir */
+int platform_list_dir(const char *dir, platform_dir_func func, void *arg);
+
+#endif
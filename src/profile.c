@@ -0,0 +1,97 @@
+#include "profile.h"
+
+#include <string.h>
+
+static void profile_print_ops(FILE *f, const struct chip8_profile *profile);
+static void profile_print_hot(FILE *f, const struct chip8_profile *profile,
+                              const uint8_t *mem, int top);
+
+void profile_report(FILE *f, const struct chip8_profile *profile,
+                    const uint8_t *mem, int top,
+                    double seconds)
+{
+    fprintf(f, "%llu instructions in %.3fs (%.0f IPS)\n",
+            (unsigned long long)profile->cycles, seconds,
+            seconds > 0 ? profile->cycles / seconds : 0.0);
+
+    if (profile->cycles == 0) {
+        return;
+    }
+
+    profile_print_ops(f, profile);
+    profile_print_hot(f, profile, mem, top);
+}
+
+static void profile_print_ops(FILE *f, const struct chip8_profile *profile)
+{
+    uint8_t order[CHIP8_OP_COUNT];
+
+    for (int op = 0; op < CHIP8_OP_COUNT; ++op) {
+        order[op] = op;
+    }
+
+    /* Insertion sort, most executed first */
+    for (int a = 1; a < CHIP8_OP_COUNT; ++a) {
+        uint8_t op = order[a];
+        int b = a;
+
+        while (b > 0 && profile->op_counts[order[b - 1]]
+                        < profile->op_counts[op]) {
+            order[b] = order[b - 1];
+            --b;
+        }
+
+        order[b] = op;
+    }
+
+    fprintf(f, "By instruction:\n");
+
+    for (int k = 0; k < CHIP8_OP_COUNT; ++k) {
+        uint64_t count = profile->op_counts[order[k]];
+
+        if (count == 0) {
+            break;
+        }
+
+        fprintf(f, "  %-20s %12llu %6.2f%%\n", chip8_op_mnemonic(order[k]),
+                (unsigned long long)count, 100.0 * count / profile->cycles);
+    }
+}
+
+static void profile_print_hot(FILE *f, const struct chip8_profile *profile,
+                              const uint8_t *mem, int top)
+{
+    uint8_t taken[RAM_SIZE];
+
+    memset(taken, 0, sizeof(taken));
+    fprintf(f, "Hot addresses:\n");
+
+    /* Repeatedly pick the largest remaining counter; top is small */
+    for (int k = 0; k < top; ++k) {
+        struct chip8_insn insn;
+        char text[32];
+        uint64_t best_count = 0;
+        int best = -1;
+
+        for (int addr = 0; addr < RAM_SIZE; ++addr) {
+            if (!taken[addr] && profile->pc_counts[addr] > best_count) {
+                best_count = profile->pc_counts[addr];
+                best = addr;
+            }
+        }
+
+        if (best < 0) {
+            break;
+        }
+
+        taken[best] = 1;
+
+        /* Disassembled from the memory image passed in */
+        chip8_decode((mem[best] << 8u) | mem[(best + 1) % RAM_SIZE], &insn);
+        chip8_disasm(&insn, text, sizeof(text));
+
+        fprintf(f, "  %03X  %04X  %-20s %12llu %6.2f%%\n", best,
+                insn.opcode, text, (unsigned long long)best_count,
+                100.0 * best_count / profile->cycles);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef CHIP8_PROFILE_H
+#define CHIP8_PROFILE_H
+
+#include "chip8.h"
+
+#include <stdio.h>
+
+/* Instruction-level profiling. Build with -DCHIP8_PROFILE=1 and point
+ * chip8_context::profile at a zeroed struct chip8_profile; every
+ * interpreted instruction then bumps its opcode class and pc counters.
+ * Instructions the JIT compiles natively are not counted. Without
+ * CHIP8_PROFILE the counting compiles away entirely. */
+
+void profile_report(FILE *f, const struct chip8_profile *profile,
+                    const uint8_t *mem, int top,
+                    double seconds);
+
+#endif
@@ -0,0 +1,89 @@
+#include "queue.h"
+
+#include <string.h>
+
+#define FRAME_QUEUE_FRESH 4
+#define FRAME_QUEUE_INDEX 3
+
+void input_queue_init(struct input_queue *queue)
+{
+    memset(queue, 0, sizeof(*queue));
+}
+
+int input_queue_push(struct input_queue *queue,
+                     const struct input_event *event)
+{
+    /* Returns 1 if the queue is full */
+    int head = SDL_AtomicGet(&queue->head);
+
+    if (head - SDL_AtomicGet(&queue->tail) == INPUT_QUEUE_SIZE) {
+        return 1;
+    }
+
+    queue->events[head & (INPUT_QUEUE_SIZE - 1)] = *event;
+
+    /* The event must be visible before the new head */
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->head, head + 1);
+
+    return 0;
+}
+
+int input_queue_pop(struct input_queue *queue, struct input_event *event)
+{
+    /* Returns 1 if the queue is empty */
+    int tail = SDL_AtomicGet(&queue->tail);
+
+    if (SDL_AtomicGet(&queue->head) == tail) {
+        return 1;
+    }
+
+    SDL_MemoryBarrierAcquire();
+    *event = queue->events[tail & (INPUT_QUEUE_SIZE - 1)];
+
+    /* Done reading the slot before the producer may reuse it */
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->tail, tail + 1);
+
+    return 0;
+}
+
+void frame_queue_init(struct frame_queue *queue)
+{
+    memset(queue, 0, sizeof(*queue));
+
+    queue->front = 0;
+    SDL_AtomicSet(&queue->middle, 1);
+    queue->back = 2;
+}
+
+struct frame *frame_queue_back(struct frame_queue *queue)
+{
+    /* The producer fills this slot, then publishes it */
+    return &queue->frames[queue->back];
+}
+
+void frame_queue_publish(struct frame_queue *queue)
+{
+    /* Swap the finished back slot into the middle; an earlier frame the
+     * consumer never took is simply overwritten next time round */
+    SDL_MemoryBarrierRelease();
+    queue->back = SDL_AtomicSet(&queue->middle,
+                                queue->back | FRAME_QUEUE_FRESH)
+                  & FRAME_QUEUE_INDEX;
+}
+
+const struct frame *frame_queue_acquire(struct frame_queue *queue)
+{
+    /* Latest published frame, or NULL if nothing new since the last call.
+     * The frame stays valid until the next call. */
+    if (!(SDL_AtomicGet(&queue->middle) & FRAME_QUEUE_FRESH)) {
+        return NULL;
+    }
+
+    queue->front = SDL_AtomicSet(&queue->middle, queue->front)
+                   & FRAME_QUEUE_INDEX;
+    SDL_MemoryBarrierAcquire();
+
+    return &queue->frames[queue->front];
+}
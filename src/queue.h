@@ -0,0 +1,86 @@
+#ifndef CHIP8_QUEUE_H
+#define CHIP8_QUEUE_H
+
+#include "chip8.h"
+
+#include <SDL2/SDL.h>
+
+/* Lock-free hand-off between the SDL thread and the emulation thread: input
+ * events go one way through a single-producer/single-consumer ring, finished
+ * frames come back through a triple buffer. Each side must stay on its own
+ * thread. */
+
+/* Must be a power of two */
+#define INPUT_QUEUE_SIZE 256
+
+/* Key reads carried by each frame, see struct frame */
+#define FRAME_INPUTS 8
+
+/* Keeps the producer and consumer indices on separate cache lines */
+#define QUEUE_CACHE_LINE 64
+
+enum input_type {
+    INPUT_KEY_DOWN,
+    INPUT_KEY_UP,
+    INPUT_REWIND_DOWN,
+    INPUT_REWIND_UP
+};
+
+struct input_event {
+    uint8_t type;
+
+    /* CHIP-8 key for INPUT_KEY_* */
+    uint8_t key;
+
+    /* SDL_GetPerformanceCounter when the event was polled */
+    Uint64 time;
+};
+
+struct input_queue {
+    /* Next slot to write, only advanced by the producer */
+    SDL_atomic_t head;
+    char head_pad[QUEUE_CACHE_LINE - sizeof(SDL_atomic_t)];
+
+    /* Next slot to read, only advanced by the consumer */
+    SDL_atomic_t tail;
+    char tail_pad[QUEUE_CACHE_LINE - sizeof(SDL_atomic_t)];
+
+    struct input_event events[INPUT_QUEUE_SIZE];
+};
+
+struct frame {
+    uint64_t display[DISPLAY_PLANES][DISPLAY_HEIGHT][DISPLAY_WORDS];
+
+    /* Number of key events the core had read by this frame, and the event
+     * times of the last FRAME_INPUTS of them, read n at input_time[n %
+     * FRAME_INPUTS]. Frames can be skipped, so each one repeats the recent
+     * history rather than only what's new. */
+    uint32_t input_seq;
+    Uint64 input_time[FRAME_INPUTS];
+};
+
+struct frame_queue {
+    struct frame frames[3];
+
+    /* Index of the slot between the two sides, with FRAME_QUEUE_FRESH set
+     * while it holds a frame the consumer hasn't taken yet */
+    SDL_atomic_t middle;
+
+    /* Slot owned by the producer */
+    int back;
+
+    /* Slot owned by the consumer */
+    int front;
+};
+
+void input_queue_init(struct input_queue *queue);
+int input_queue_push(struct input_queue *queue,
+                     const struct input_event *event);
+int input_queue_pop(struct input_queue *queue, struct input_event *event);
+
+void frame_queue_init(struct frame_queue *queue);
+struct frame *frame_queue_back(struct frame_queue *queue);
+void frame_queue_publish(struct frame_queue *queue);
+const struct frame *frame_queue_acquire(struct frame_queue *queue);
+
+#endif
@@ -0,0 +1,99 @@
+#include "quirkdb.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int quirkdb_add(struct quirkdb *db, uint64_t hash, int quirks);
+
+void quirkdb_init(struct quirkdb *db)
+{
+    memset(db, 0, sizeof(*db));
+}
+
+void quirkdb_free(struct quirkdb *db)
+{
+    free(db->entries);
+    memset(db, 0, sizeof(*db));
+}
+
+int quirkdb_load(struct quirkdb *db, const char *path)
+{
+    /* Returns 0, -1 if the file can't be read or memory runs out, or the
+     * number of the first line that isn't a hash and a known profile */
+    FILE *f = NULL;
+    char line[256];
+    int number = 0;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char *comment = strchr(line, '#');
+        char name[32];
+        unsigned long long hash;
+        int fields;
+        int quirks;
+
+        ++number;
+
+        if (comment) {
+            *comment = '\0';
+        }
+
+        fields = sscanf(line, "%llx %31s", &hash, name);
+
+        if (fields == EOF) {
+            continue;
+        }
+
+        if (fields != 2 || (quirks = chip8_quirks_parse(name)) < 0) {
+            fclose(f);
+            return number;
+        }
+
+        if (quirkdb_add(db, hash, quirks)) {
+            fclose(f);
+            return -1;
+        }
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+int quirkdb_lookup(const struct quirkdb *db, uint64_t hash)
+{
+    /* The profile for a ROM hash, or -1; later lines win */
+    for (int e = db->count - 1; e >= 0; --e) {
+        if (db->entries[e].hash == hash) {
+            return db->entries[e].quirks;
+        }
+    }
+
+    return -1;
+}
+
+static int quirkdb_add(struct quirkdb *db, uint64_t hash, int quirks)
+{
+    if (db->count == db->capacity) {
+        int capacity = db->capacity ? db->capacity * 2 : 64;
+        struct quirkdb_entry *grown = realloc(db->entries,
+                                              capacity * sizeof(*grown));
+
+        if (!grown) {
+            return 1;
+        }
+
+        db->entries = grown;
+        db->capacity = capacity;
+    }
+
+    db->entries[db->count].hash = hash;
+    db->entries[db->count].quirks = quirks;
+    db->count++;
+
+    return 0;
+}
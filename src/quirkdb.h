@@ -0,0 +1,27 @@
+#ifndef CHIP8_QUIRKDB_H
+#define CHIP8_QUIRKDB_H
+
+#include "chip8.h"
+
+/* Quirk profiles by ROM, read from a text file with one "<hash> <profile>"
+ * per line: the hash is chip8_program_hash of the freshly loaded ROM as 16
+ * hex digits, the profile a name from CHIP8_QUIRK_PROFILES. Blank lines
+ * and anything after a '#' are ignored. */
+
+struct quirkdb_entry {
+    uint64_t hash;
+    int quirks;
+};
+
+struct quirkdb {
+    struct quirkdb_entry *entries;
+    int count;
+    int capacity;
+};
+
+void quirkdb_init(struct quirkdb *db);
+void quirkdb_free(struct quirkdb *db);
+int quirkdb_load(struct quirkdb *db, const char *path);
+int quirkdb_lookup(const struct quirkdb *db, uint64_t hash);
+
+#endif
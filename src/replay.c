@@ -0,0 +1,231 @@
+#include "replay.h"
+#include "bytes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void replay_record_event(struct replay_recorder *rec, uint64_t cycle,
+                                uint8_t event);
+static int replay_write_header(struct replay_recorder *rec);
+
+int replay_record_open(struct replay_recorder *rec, const char *path,
+                       const struct chip8_context *ctx)
+{
+    /* Starts a recording of ctx as it is now, freshly loaded and seeded */
+    memset(rec, 0, sizeof(*rec));
+    rec->header.program_hash = chip8_program_hash(ctx);
+    rec->header.seed = ctx->seed;
+    rec->header.quirks = ctx->quirks;
+    rec->header.variant = CHIP8_VARIANT;
+
+    if ((rec->file = fopen(path, "wb")) == NULL) {
+        return 1;
+    }
+
+    /* The totals and final hashes are filled in by replay_record_close */
+    if (replay_write_header(rec)) {
+        fclose(rec->file);
+        rec->file = NULL;
+        return 1;
+    }
+
+    return 0;
+}
+
+void replay_record_key(struct replay_recorder *rec, uint64_t cycle,
+                       int key, int down)
+{
+    replay_record_event(rec, cycle, (uint8_t)((key & REPLAY_EVENT_KEY_MASK)
+                                              | (down
+                                                 ? REPLAY_EVENT_KEY_DOWN
+                                                 : 0)));
+}
+
+void replay_record_tick(struct replay_recorder *rec, uint64_t cycle)
+{
+    replay_record_event(rec, cycle, REPLAY_EVENT_TICK);
+}
+
+int replay_record_close(struct replay_recorder *rec, uint64_t cycle,
+                        const struct chip8_context *ctx)
+{
+    /* Returns 1 if anything failed to write */
+    int failed;
+
+    rec->header.cycles = cycle;
+    rec->header.display_hash = chip8_hash(ctx->display,
+                                          sizeof(ctx->display));
+    rec->header.mem_hash = chip8_hash(ctx->mem, sizeof(ctx->mem));
+
+    failed = fseek(rec->file, 0, SEEK_SET) != 0 || replay_write_header(rec);
+    failed |= ferror(rec->file) != 0;
+    failed |= fclose(rec->file) != 0;
+    rec->file = NULL;
+
+    return failed;
+}
+
+int replay_load(struct replay *replay, const char *path)
+{
+    /* Returns a replay_status; replay is only filled in on REPLAY_OK */
+    uint8_t header[REPLAY_HEADER_SIZE];
+    FILE *f;
+    long size;
+
+    memset(replay, 0, sizeof(*replay));
+
+    if ((f = fopen(path, "rb")) == NULL) {
+        return REPLAY_OPEN_FAILED;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0
+        || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return REPLAY_READ_FAILED;
+    }
+
+    if (size < REPLAY_HEADER_SIZE
+        || fread(header, 1, sizeof(header), f) != sizeof(header)
+        || memcmp(header, "C8RP", 4) != 0) {
+        fclose(f);
+        return REPLAY_BAD_HEADER;
+    }
+
+    if (get_u16(header + 4) != REPLAY_VERSION) {
+        fclose(f);
+        return REPLAY_BAD_VERSION;
+    }
+
+    replay->size = (size_t)size - REPLAY_HEADER_SIZE;
+
+    /* malloc(0) may return NULL, so always ask for a byte */
+    if ((replay->events = malloc(replay->size + 1)) == NULL
+        || fread(replay->events, 1, replay->size, f) != replay->size) {
+        free(replay->events);
+        replay->events = NULL;
+        fclose(f);
+        return REPLAY_READ_FAILED;
+    }
+
+    fclose(f);
+
+    replay->header.program_hash = get_u64(header + 8);
+    replay->header.seed = get_u64(header + 16);
+    replay->header.quirks = header[6];
+    replay->header.variant = header[7];
+    replay->header.cycles = get_u64(header + 24);
+    replay->header.display_hash = get_u64(header + 32);
+    replay->header.mem_hash = get_u64(header + 40);
+
+    return REPLAY_OK;
+}
+
+void replay_free(struct replay *replay)
+{
+    free(replay->events);
+    replay->events = NULL;
+}
+
+const char *replay_status_string(int status)
+{
+    switch (status) {
+    case REPLAY_OK:
+        return "ok";
+
+    case REPLAY_OPEN_FAILED:
+        return "could not open file";
+
+    case REPLAY_READ_FAILED:
+        return "could not read file";
+
+    case REPLAY_BAD_HEADER:
+        return "not a replay";
+
+    case REPLAY_BAD_VERSION:
+        return "unsupported replay version";
+
+    default:
+        return "unknown error";
+    }
+}
+
+int replay_next(const struct replay *replay, size_t *pos, uint64_t *delta,
+                uint8_t *event)
+{
+    /* Reads the event at *pos and moves past it; returns 1 at the end of
+     * the events, or if the last one is cut short. Starts from *pos = 0;
+     * the replay itself isn't changed, so threads can share it. */
+    uint64_t value = 0;
+    int shift = 0;
+
+    for (;;) {
+        uint8_t byte;
+
+        if (*pos >= replay->size || shift > 63) {
+            return 1;
+        }
+
+        byte = replay->events[(*pos)++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+
+    if (*pos >= replay->size) {
+        return 1;
+    }
+
+    *delta = value;
+    *event = replay->events[(*pos)++];
+
+    return 0;
+}
+
+void replay_apply(struct chip8_context *ctx, uint8_t event)
+{
+    if (event == REPLAY_EVENT_TICK) {
+        chip8_tick_timers(ctx);
+    } else {
+        ctx->keys[event & REPLAY_EVENT_KEY_MASK] =
+            (event & REPLAY_EVENT_KEY_DOWN) != 0;
+    }
+}
+
+static void replay_record_event(struct replay_recorder *rec, uint64_t cycle,
+                                uint8_t event)
+{
+    /* LEB128 instruction count since the last event, then the event */
+    uint8_t bytes[11];
+    uint64_t delta = cycle - rec->last_cycle;
+    int n = 0;
+
+    do {
+        bytes[n] = (uint8_t)(delta & 0x7F);
+        delta >>= 7;
+        bytes[n++] |= delta ? 0x80 : 0;
+    } while (delta);
+
+    bytes[n++] = event;
+    fwrite(bytes, 1, n, rec->file);
+    rec->last_cycle = cycle;
+}
+
+static int replay_write_header(struct replay_recorder *rec)
+{
+    uint8_t header[REPLAY_HEADER_SIZE];
+
+    memcpy(header, "C8RP", 4);
+    put_u16(header + 4, REPLAY_VERSION);
+    header[6] = (uint8_t)rec->header.quirks;
+    header[7] = (uint8_t)rec->header.variant;
+    put_u64(header + 8, rec->header.program_hash);
+    put_u64(header + 16, rec->header.seed);
+    put_u64(header + 24, rec->header.cycles);
+    put_u64(header + 32, rec->header.display_hash);
+    put_u64(header + 40, rec->header.mem_hash);
+
+    return fwrite(header, 1, sizeof(header), rec->file) != sizeof(header);
+}
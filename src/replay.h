@@ -0,0 +1,81 @@
+#ifndef CHIP8_REPLAY_H
+#define CHIP8_REPLAY_H
+
+#include "chip8.h"
+
+#include <stdio.h>
+
+/* Input recordings for deterministic replay. Events are keyed by the
+ * number of instructions run before them, not by wall time, so a replay
+ * reproduces the session exactly at any speed.
+ *
+ * File layout, little-endian: "C8RP", u16 version, u8 quirk profile, u8
+ * CHIP8_VARIANT, then u64 program hash, seed, total instructions, final
+ * display hash and final memory hash. Events follow to the end of the file,
+ * each a LEB128 count of instructions since the previous event and one
+ * event byte. */
+
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 48
+
+/* Event byte: a 60Hz timer tick, or a key change */
+#define REPLAY_EVENT_TICK 0x20
+#define REPLAY_EVENT_KEY_DOWN 0x10
+#define REPLAY_EVENT_KEY_MASK 0x0F
+
+enum replay_status {
+    REPLAY_OK,
+    REPLAY_OPEN_FAILED,
+    REPLAY_READ_FAILED,
+    REPLAY_BAD_HEADER,
+    REPLAY_BAD_VERSION
+};
+
+struct replay_header {
+    /* chip8_program_hash of the machine the session started from */
+    uint64_t program_hash;
+    uint64_t seed;
+
+    /* enum chip8_quirks; files from before profiles have 0, none */
+    int quirks;
+
+    /* CHIP8_VARIANT of the build that recorded it; files from before
+     * variants have 0, CHIP-8 */
+    int variant;
+
+    /* Instructions run over the whole session */
+    uint64_t cycles;
+
+    /* chip8_hash of display and mem when the session ended */
+    uint64_t display_hash;
+    uint64_t mem_hash;
+};
+
+struct replay_recorder {
+    FILE *file;
+    struct replay_header header;
+    uint64_t last_cycle;
+};
+
+struct replay {
+    struct replay_header header;
+    uint8_t *events;
+    size_t size;
+};
+
+int replay_record_open(struct replay_recorder *rec, const char *path,
+                       const struct chip8_context *ctx);
+void replay_record_key(struct replay_recorder *rec, uint64_t cycle,
+                       int key, int down);
+void replay_record_tick(struct replay_recorder *rec, uint64_t cycle);
+int replay_record_close(struct replay_recorder *rec, uint64_t cycle,
+                        const struct chip8_context *ctx);
+
+int replay_load(struct replay *replay, const char *path);
+void replay_free(struct replay *replay);
+const char *replay_status_string(int status);
+int replay_next(const struct replay *replay, size_t *pos, uint64_t *delta,
+                uint8_t *event);
+void replay_apply(struct chip8_context *ctx, uint8_t event);
+
+#endif
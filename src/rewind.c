@@ -0,0 +1,285 @@
+#include "rewind.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Record framing: the total size, with this bit set for keyframes, both
+ * before and after the payload so the ring can be walked from either end */
+#define RECORD_KEYFRAME 0x80000000u
+#define RECORD_FRAMING 4
+
+/* Unchanged bytes shorter than this are cheaper kept in a literal run than
+ * split into a new token */
+#define MIN_SKIP 4
+
+/* Token skips and lengths are u16; longer spans are split */
+#define TOKEN_MAX 0xFFFF
+
+static size_t rewind_encode(uint8_t *out, const uint8_t *state,
+                            const uint8_t *next);
+static void rewind_decode(uint8_t *state, const uint8_t *in, size_t size);
+static void rewind_evict(struct rewind_buffer *rw);
+static void ring_write(struct rewind_buffer *rw, size_t pos,
+                       const void *src, size_t len);
+static void ring_read(const struct rewind_buffer *rw, size_t pos,
+                      void *dst, size_t len);
+static void ring_write_u32(struct rewind_buffer *rw, size_t pos,
+                           uint32_t value);
+static uint32_t ring_read_u32(const struct rewind_buffer *rw, size_t pos);
+
+int rewind_init(struct rewind_buffer *rw, uint32_t max_frames,
+                size_t capacity, uint32_t keyframe_interval)
+{
+    memset(rw, 0, sizeof(*rw));
+
+    if ((rw->ring = malloc(capacity)) == NULL) {
+        return 1;
+    }
+
+    rw->capacity = capacity;
+    rw->max_frames = max_frames;
+    rw->keyframe_interval = keyframe_interval;
+
+    return 0;
+}
+
+void rewind_cleanup(struct rewind_buffer *rw)
+{
+    free(rw->ring);
+    rw->ring = NULL;
+}
+
+void rewind_clear(struct rewind_buffer *rw)
+{
+    rw->head = 0;
+    rw->tail = 0;
+    rw->used = 0;
+    rw->frames = 0;
+    rw->since_keyframe = 0;
+    rw->has_current = 0;
+}
+
+void rewind_push(struct rewind_buffer *rw, const struct chip8_context *ctx)
+{
+    uint8_t next[CHIP8_STATE_SIZE];
+    uint32_t flags = 0;
+    size_t payload;
+    size_t total;
+
+    chip8_save_state(ctx, next, sizeof(next));
+
+    if (!rw->has_current) {
+        /* Nothing earlier to go back to yet */
+        memcpy(rw->current, next, sizeof(next));
+        rw->has_current = 1;
+        return;
+    }
+
+    /* The record takes us from next back to current */
+    if (++rw->since_keyframe >= rw->keyframe_interval) {
+        payload = rewind_encode(rw->scratch, rw->current, NULL);
+        flags = RECORD_KEYFRAME;
+        rw->since_keyframe = 0;
+    } else {
+        payload = rewind_encode(rw->scratch, rw->current, next);
+    }
+
+    total = payload + RECORD_FRAMING * 2;
+
+    if (total > rw->capacity || rw->max_frames == 0) {
+        rewind_clear(rw);
+        memcpy(rw->current, next, sizeof(next));
+        rw->has_current = 1;
+        return;
+    }
+
+    while (rw->used + total > rw->capacity || rw->frames >= rw->max_frames) {
+        rewind_evict(rw);
+    }
+
+    ring_write_u32(rw, rw->head, (uint32_t)total | flags);
+    ring_write(rw, rw->head + RECORD_FRAMING, rw->scratch, payload);
+    ring_write_u32(rw, rw->head + RECORD_FRAMING + payload,
+                   (uint32_t)total | flags);
+
+    rw->head = (rw->head + total) % rw->capacity;
+    rw->used += total;
+    rw->frames++;
+
+    memcpy(rw->current, next, sizeof(next));
+}
+
+int rewind_pop(struct rewind_buffer *rw, struct chip8_context *ctx)
+{
+    /* Steps ctx back one frame; returns 1 if the history is empty */
+    uint32_t footer;
+    size_t total;
+    size_t start;
+
+    if (rw->frames == 0) {
+        return 1;
+    }
+
+    footer = ring_read_u32(rw, (rw->head + rw->capacity - RECORD_FRAMING)
+                               % rw->capacity);
+    total = footer & ~RECORD_KEYFRAME;
+    start = (rw->head + rw->capacity - total) % rw->capacity;
+
+    ring_read(rw, start + RECORD_FRAMING, rw->scratch,
+              total - RECORD_FRAMING * 2);
+
+    if (footer & RECORD_KEYFRAME) {
+        memset(rw->current, 0, sizeof(rw->current));
+    }
+
+    rewind_decode(rw->current, rw->scratch, total - RECORD_FRAMING * 2);
+
+    rw->head = start;
+    rw->used -= total;
+    rw->frames--;
+
+    return chip8_load_state(ctx, rw->current, sizeof(rw->current));
+}
+
+static size_t rewind_encode(uint8_t *out, const uint8_t *state,
+                            const uint8_t *next)
+{
+    /* state XOR next (or state alone if next is NULL) as tokens of
+     * [skip u16][length u16][length XOR bytes]. Every token after the first
+     * skips at least MIN_SKIP bytes, or follows a span split at TOKEN_MAX,
+     * which keeps the output under REWIND_RECORD_MAX. */
+    static const uint8_t zero[CHIP8_STATE_SIZE];
+    const size_t size = CHIP8_STATE_SIZE;
+    size_t pos = 0;
+    uint8_t *p = out;
+
+    if (!next) {
+        next = zero;
+    }
+
+    while (pos < size) {
+        size_t skip_start = pos;
+        size_t run_start;
+        size_t same = 0;
+
+        /* Skip unchanged bytes a word at a time */
+        while (pos + 8 <= size && pos + 8 - skip_start <= TOKEN_MAX) {
+            uint64_t a;
+            uint64_t b;
+
+            memcpy(&a, state + pos, 8);
+            memcpy(&b, next + pos, 8);
+
+            if (a != b) {
+                break;
+            }
+
+            pos += 8;
+        }
+
+        while (pos < size && state[pos] == next[pos]
+               && pos - skip_start < TOKEN_MAX) {
+            ++pos;
+        }
+
+        if (pos == size) {
+            break;
+        }
+
+        /* Literal run up to the next MIN_SKIP unchanged bytes */
+        run_start = pos;
+
+        while (pos < size && same < MIN_SKIP && pos - run_start < TOKEN_MAX) {
+            same = state[pos] == next[pos] ? same + 1 : 0;
+            ++pos;
+        }
+
+        pos -= same;
+
+        p[0] = (uint8_t)(run_start - skip_start);
+        p[1] = (uint8_t)((run_start - skip_start) >> 8);
+        p[2] = (uint8_t)(pos - run_start);
+        p[3] = (uint8_t)((pos - run_start) >> 8);
+        p += 4;
+
+        for (size_t b = run_start; b < pos; ++b) {
+            *p++ = state[b] ^ next[b];
+        }
+    }
+
+    return (size_t)(p - out);
+}
+
+static void rewind_decode(uint8_t *state, const uint8_t *in, size_t size)
+{
+    const uint8_t *end = in + size;
+    size_t pos = 0;
+
+    while (in + 4 <= end) {
+        size_t skip = in[0] | (in[1] << 8);
+        size_t len = in[2] | (in[3] << 8);
+
+        in += 4;
+        pos += skip;
+
+        for (size_t b = 0; b < len; ++b) {
+            state[pos + b] ^= in[b];
+        }
+
+        in += len;
+        pos += len;
+    }
+}
+
+static void rewind_evict(struct rewind_buffer *rw)
+{
+    /* Drop the oldest record */
+    size_t total = ring_read_u32(rw, rw->tail) & ~RECORD_KEYFRAME;
+
+    rw->tail = (rw->tail + total) % rw->capacity;
+    rw->used -= total;
+    rw->frames--;
+}
+
+static void ring_write(struct rewind_buffer *rw, size_t pos,
+                       const void *src, size_t len)
+{
+    size_t start = pos % rw->capacity;
+    size_t first = rw->capacity - start < len ? rw->capacity - start : len;
+
+    memcpy(rw->ring + start, src, first);
+    memcpy(rw->ring, (const uint8_t *)src + first, len - first);
+}
+
+static void ring_read(const struct rewind_buffer *rw, size_t pos,
+                      void *dst, size_t len)
+{
+    size_t start = pos % rw->capacity;
+    size_t first = rw->capacity - start < len ? rw->capacity - start : len;
+
+    memcpy(dst, rw->ring + start, first);
+    memcpy((uint8_t *)dst + first, rw->ring, len - first);
+}
+
+static void ring_write_u32(struct rewind_buffer *rw, size_t pos,
+                           uint32_t value)
+{
+    uint8_t bytes[4];
+
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    bytes[2] = (uint8_t)(value >> 16);
+    bytes[3] = (uint8_t)(value >> 24);
+
+    ring_write(rw, pos, bytes, sizeof(bytes));
+}
+
+static uint32_t ring_read_u32(const struct rewind_buffer *rw, size_t pos)
+{
+    uint8_t bytes[4];
+
+    ring_read(rw, pos, bytes, sizeof(bytes));
+
+    return bytes[0] | (bytes[1] << 8) | ((uint32_t)bytes[2] << 16)
+           | ((uint32_t)bytes[3] << 24);
+}
@@ -0,0 +1,48 @@
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+
+#include "chip8.h"
+
+#include <stddef.h>
+
+/* Rewind history: one record per pushed frame in a fixed-size byte ring.
+ * A record restores the frame before the one that followed it, normally as
+ * a zero-run encoded XOR against that next frame; every keyframe_interval
+ * records one is stored whole instead. The oldest records are dropped to
+ * stay within the byte and frame limits. */
+
+#define REWIND_DEFAULT_FRAMES (60 * 60)
+#define REWIND_DEFAULT_CAPACITY (8 * 1024 * 1024)
+#define REWIND_DEFAULT_KEYFRAME_INTERVAL 60
+
+/* Worst case for an encoded record, see rewind_encode */
+#define REWIND_RECORD_MAX (CHIP8_STATE_SIZE * 2 + 16 \
+                           + (CHIP8_STATE_SIZE / 0xFFFF + 1) * 8)
+
+struct rewind_buffer {
+    uint8_t *ring;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    size_t used;
+
+    uint32_t frames;
+    uint32_t max_frames;
+    uint32_t keyframe_interval;
+    uint32_t since_keyframe;
+
+    /* Newest pushed state, 0 until the first push */
+    int has_current;
+    uint8_t current[CHIP8_STATE_SIZE];
+
+    uint8_t scratch[REWIND_RECORD_MAX];
+};
+
+int rewind_init(struct rewind_buffer *rw, uint32_t max_frames,
+                size_t capacity, uint32_t keyframe_interval);
+void rewind_cleanup(struct rewind_buffer *rw);
+void rewind_clear(struct rewind_buffer *rw);
+void rewind_push(struct rewind_buffer *rw, const struct chip8_context *ctx);
+int rewind_pop(struct rewind_buffer *rw, struct chip8_context *ctx);
+
+#endif
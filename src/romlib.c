@@ -0,0 +1,110 @@
+#include "romlib.h"
+#include "platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void romlib_add_file(const char *path, void *arg);
+static int romlib_compare(const void *a, const void *b);
+
+void romlib_init(struct romlib *lib)
+{
+    memset(lib, 0, sizeof(*lib));
+}
+
+void romlib_free(struct romlib *lib)
+{
+    for (int r = 0; r < lib->count; ++r) {
+        platform_unmap_file(lib->entries[r].data, lib->entries[r].size);
+        free(lib->entries[r].path);
+    }
+
+    free(lib->entries);
+    memset(lib, 0, sizeof(*lib));
+}
+
+const struct romlib_entry *romlib_add(struct romlib *lib, const char *path)
+{
+    /* Adds an entry even if the ROM is unusable, so the caller can report
+     * its status. Returns NULL only when out of memory. */
+    struct romlib_entry *rom;
+    size_t len = strlen(path);
+
+    if (lib->count == lib->capacity) {
+        int capacity = lib->capacity ? lib->capacity * 2 : 16;
+        struct romlib_entry *grown = realloc(lib->entries,
+                                             capacity * sizeof(*grown));
+
+        if (!grown) {
+            return NULL;
+        }
+
+        lib->entries = grown;
+        lib->capacity = capacity;
+    }
+
+    rom = &lib->entries[lib->count];
+    memset(rom, 0, sizeof(*rom));
+
+    if ((rom->path = malloc(len + 1)) == NULL) {
+        return NULL;
+    }
+
+    memcpy(rom->path, path, len + 1);
+    lib->count++;
+
+    if (platform_map_file(path, &rom->data, &rom->size)) {
+        rom->status = CHIP8_ROM_OPEN_FAILED;
+    } else if (rom->size == 0) {
+        rom->status = CHIP8_ROM_EMPTY;
+    } else if (rom->size > CHIP8_ROM_MAX) {
+        rom->status = CHIP8_ROM_TOO_LARGE;
+    } else {
+        rom->status = CHIP8_ROM_OK;
+    }
+
+    if (rom->status == CHIP8_ROM_OK) {
+        rom->hash = chip8_hash(rom->data, rom->size);
+    } else {
+        platform_unmap_file(rom->data, rom->size);
+        rom->data = NULL;
+        rom->size = 0;
+    }
+
+    return rom;
+}
+
+int romlib_add_dir(struct romlib *lib, const char *dir)
+{
+    /* Every regular file in dir, sorted by path */
+    int first = lib->count;
+
+    if (platform_list_dir(dir, romlib_add_file, lib)) {
+        return 1;
+    }
+
+    qsort(&lib->entries[first], lib->count - first, sizeof(*lib->entries),
+          romlib_compare);
+
+    return 0;
+}
+
+int romlib_load(const struct romlib_entry *rom, struct chip8_context *ctx)
+{
+    if (rom->status != CHIP8_ROM_OK) {
+        return rom->status;
+    }
+
+    return chip8_loadrom_mem(ctx, rom->data, rom->size);
+}
+
+static void romlib_add_file(const char *path, void *arg)
+{
+    romlib_add(arg, path);
+}
+
+static int romlib_compare(const void *a, const void *b)
+{
+    return strcmp(((const struct romlib_entry *)a)->path,
+                  ((const struct romlib_entry *)b)->path);
+}
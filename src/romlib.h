@@ -0,0 +1,37 @@
+#ifndef CHIP8_ROMLIB_H
+#define CHIP8_ROMLIB_H
+
+#include "chip8.h"
+
+#include <stddef.h>
+
+/* ROM library: files are mapped once, hashed and size-checked up front, so
+ * any number of contexts can be loaded from them with a single copy each.
+ * Entries are read-only once loading is done and safe to share between
+ * threads. */
+
+struct romlib_entry {
+    char *path;
+    const uint8_t *data;
+    size_t size;
+
+    /* chip8_hash of the image */
+    uint64_t hash;
+
+    /* enum chip8_rom_status; data is only valid for CHIP8_ROM_OK */
+    int status;
+};
+
+struct romlib {
+    struct romlib_entry *entries;
+    int count;
+    int capacity;
+};
+
+void romlib_init(struct romlib *lib);
+void romlib_free(struct romlib *lib);
+const struct romlib_entry *romlib_add(struct romlib *lib, const char *path);
+int romlib_add_dir(struct romlib *lib, const char *dir);
+int romlib_load(const struct romlib_entry *rom, struct chip8_context *ctx);
+
+#endif
@@ -2,8 +2,12 @@
 
 #include "chip8.h"
 
-static void sdl_update_key(struct chip8_context *cpu_ctx,
-                           SDL_Scancode scancode, int down);
+static int sdl_key(SDL_Scancode scancode);
+
+/* RGBA colour for each combination of plane bits */
+static const uint32_t palette[4] = {
+    0x00000000, 0xFFFFFFFF, 0xAA4400FF, 0x55AA55FF
+};
 
 int sdl_init(struct sdl_context *ctx)
 {
@@ -25,7 +29,8 @@ int sdl_init(struct sdl_context *ctx)
     }
 
     ctx->renderer = SDL_CreateRenderer(ctx->window, -1,
-                                       SDL_RENDERER_ACCELERATED);
+                                       SDL_RENDERER_ACCELERATED
+                                       | SDL_RENDERER_PRESENTVSYNC);
 
     if (!ctx->renderer) {
         sdl_cleanup(ctx);
@@ -35,13 +40,16 @@ int sdl_init(struct sdl_context *ctx)
     ctx->texture = SDL_CreateTexture(ctx->renderer,
                                      SDL_PIXELFORMAT_RGBA8888,
                                      SDL_TEXTUREACCESS_STREAMING,
-                                     64, 32);
+                                     DISPLAY_WIDTH, DISPLAY_HEIGHT);
 
     if (!ctx->texture) {
         sdl_cleanup(ctx);
         return 1;
     }
 
+    /* Texture contents are undefined until the first full upload */
+    ctx->redraw = 1;
+
     return 0;
 }
 
@@ -62,19 +70,52 @@ void sdl_cleanup(struct sdl_context *ctx)
     SDL_Quit();
 }
 
-int sdl_update(struct sdl_context *ctx, struct chip8_context *cpu_ctx)
+int sdl_update(struct sdl_context *ctx, struct input_queue *input)
 {
+    /* Forwards key changes to the emulation thread; returns 1 on quit */
+    struct input_event event;
+    int down;
+
     while (SDL_PollEvent(&ctx->event)) {
         switch (ctx->event.type) {
         case SDL_QUIT:
             return 1;
 
         case SDL_KEYDOWN:
-            sdl_update_key(cpu_ctx, ctx->event.key.keysym.scancode, 1);
+        case SDL_KEYUP:
+            if (ctx->event.key.repeat) {
+                break;
+            }
+
+            down = ctx->event.type == SDL_KEYDOWN;
+
+            if (ctx->event.key.keysym.scancode == SDL_SCANCODE_BACKSPACE) {
+                event.type = down ? INPUT_REWIND_DOWN : INPUT_REWIND_UP;
+                event.key = 0;
+            } else {
+                int key = sdl_key(ctx->event.key.keysym.scancode);
+
+                if (key < 0) {
+                    break;
+                }
+
+                event.type = down ? INPUT_KEY_DOWN : INPUT_KEY_UP;
+                event.key = (uint8_t)key;
+            }
+
+            event.time = SDL_GetPerformanceCounter();
+
+            /* Only full if the emulation thread has stalled for a long
+             * while; wait rather than lose a key release */
+            while (input_queue_push(input, &event)) {
+                SDL_Delay(1);
+            }
             break;
 
-        case SDL_KEYUP:
-            sdl_update_key(cpu_ctx, ctx->event.key.keysym.scancode, 0);
+        case SDL_WINDOWEVENT:
+            if (ctx->event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                ctx->redraw = 1;
+            }
             break;
 
         default:
@@ -85,95 +126,139 @@ int sdl_update(struct sdl_context *ctx, struct chip8_context *cpu_ctx)
     return 0;
 }
 
-void sdl_render(struct sdl_context *ctx, uint32_t *display)
+int sdl_render(struct sdl_context *ctx, const struct frame *frame)
 {
-    /* Update screen texture */
+    /* Presents frame if it differs from what's shown, or the last frame
+     * again after an expose. frame may be NULL if there's nothing new.
+     * Returns 1 if anything was presented. */
+    const uint64_t (*display)[DISPLAY_HEIGHT][DISPLAY_WORDS] =
+        frame ? frame->display
+              : (const uint64_t (*)[DISPLAY_HEIGHT][DISPLAY_WORDS])ctx->shown;
+    SDL_Rect rect;
     void *pixels;
     int pitch;
+    int top = DISPLAY_HEIGHT;
+    int bottom = 0;
+
+    if (ctx->redraw) {
+        top = 0;
+        bottom = DISPLAY_HEIGHT;
+    } else {
+        /* Frames may have been skipped, so find the changed rows by
+         * comparing with what the texture holds */
+        for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+            for (int row = 0; row < DISPLAY_HEIGHT; ++row) {
+                if (memcmp(display[plane][row], ctx->shown[plane][row],
+                           sizeof(ctx->shown[plane][row])) != 0) {
+                    top = row < top ? row : top;
+                    bottom = row + 1 > bottom ? row + 1 : bottom;
+                }
+            }
+        }
+
+        if (top >= bottom) {
+            /* Nothing changed since the last present */
+            return 0;
+        }
+    }
+
+    /* Update only the changed rows of the screen texture */
+    rect.x = 0;
+    rect.y = top;
+    rect.w = DISPLAY_WIDTH;
+    rect.h = bottom - top;
+
+    if (SDL_LockTexture(ctx->texture, &rect, &pixels, &pitch) == 0) {
+        /* Expand the packed rows to RGBA, a palette entry per pixel */
+        for (int row = 0; row < rect.h; ++row) {
+            uint32_t *dst = (uint32_t *)((uint8_t *)pixels + row * pitch);
+
+            for (int col = 0; col < DISPLAY_WIDTH; ++col) {
+                unsigned colour = 0;
+
+                for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+                    colour |= DISPLAY_PIXEL(display[plane][rect.y + row], col)
+                              << plane;
+                }
+
+                dst[col] = palette[colour];
+            }
+
+            /* display is shown itself when redrawing without a frame */
+            for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+                memmove(ctx->shown[plane][rect.y + row],
+                        display[plane][rect.y + row],
+                        sizeof(ctx->shown[plane][rect.y + row]));
+            }
+        }
 
-    if (SDL_LockTexture(ctx->texture, NULL, &pixels, &pitch) == 0) {
-        memcpy(pixels, display, 64 * 32 * sizeof(uint32_t));
         SDL_UnlockTexture(ctx->texture);
     }
 
+    ctx->redraw = 0;
+
     /* Update window */
     SDL_SetRenderDrawColor(ctx->renderer, 255, 255, 255, 255);
     SDL_RenderClear(ctx->renderer);
     SDL_RenderCopy(ctx->renderer, ctx->texture, NULL, NULL);
     SDL_RenderPresent(ctx->renderer);
+
+    return 1;
 }
 
-static void sdl_update_key(struct chip8_context *cpu_ctx,
-                           SDL_Scancode scancode, int down)
+static int sdl_key(SDL_Scancode scancode)
 {
-    uint8_t is_down = down ? 1 : 0;
-
+    /* CHIP-8 key for a scancode on the usual 4x4 layout, or -1 */
     switch (scancode) {
     case SDL_SCANCODE_1:
-        cpu_ctx->keys[0x1] = is_down;
-        break;
+        return 0x1;
 
     case SDL_SCANCODE_2:
-        cpu_ctx->keys[0x2] = is_down;
-        break;
+        return 0x2;
 
     case SDL_SCANCODE_3:
-        cpu_ctx->keys[0x3] = is_down;
-        break;
+        return 0x3;
 
     case SDL_SCANCODE_4:
-        cpu_ctx->keys[0xC] = is_down;
-        break;
+        return 0xC;
 
     case SDL_SCANCODE_Q:
-        cpu_ctx->keys[0x4] = is_down;
-        break;
+        return 0x4;
 
     case SDL_SCANCODE_W:
-        cpu_ctx->keys[0x5] = is_down;
-        break;
+        return 0x5;
 
     case SDL_SCANCODE_E:
-        cpu_ctx->keys[0x6] = is_down;
-        break;
+        return 0x6;
 
     case SDL_SCANCODE_R:
-        cpu_ctx->keys[0xD] = is_down;
-        break;
+        return 0xD;
 
     case SDL_SCANCODE_A:
-        cpu_ctx->keys[0x7] = is_down;
-        break;
+        return 0x7;
 
     case SDL_SCANCODE_S:
-        cpu_ctx->keys[0x8] = is_down;
-        break;
+        return 0x8;
 
     case SDL_SCANCODE_D:
-        cpu_ctx->keys[0x9] = is_down;
-        break;
+        return 0x9;
 
     case SDL_SCANCODE_F:
-        cpu_ctx->keys[0xE] = is_down;
-        break;
+        return 0xE;
 
     case SDL_SCANCODE_Z:
-        cpu_ctx->keys[0xA] = is_down;
-        break;
+        return 0xA;
 
     case SDL_SCANCODE_X:
-        cpu_ctx->keys[0x0] = is_down;
-        break;
+        return 0x0;
 
     case SDL_SCANCODE_C:
-        cpu_ctx->keys[0xB] = is_down;
-        break;
+        return 0xB;
 
     case SDL_SCANCODE_V:
-        cpu_ctx->keys[0xF] = is_down;
-        break;
+        return 0xF;
 
     default:
-        break;
+        return -1;
     }
 }
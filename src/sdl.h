@@ -4,7 +4,7 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_main.h>
 
-struct chip8_context;
+#include "queue.h"
 
 struct sdl_context
 {
@@ -12,11 +12,15 @@ struct sdl_context
     SDL_Renderer *renderer;
     SDL_Texture *texture;
     SDL_Event event;
+
+    /* Rows last uploaded to the texture */
+    uint64_t shown[DISPLAY_PLANES][DISPLAY_HEIGHT][DISPLAY_WORDS];
+    int redraw;
 };
 
 int sdl_init(struct sdl_context *ctx);
 void sdl_cleanup(struct sdl_context *ctx);
-int sdl_update(struct sdl_context *ctx, struct chip8_context *cpu_ctx);
-void sdl_render(struct sdl_context *ctx, uint32_t *display);
+int sdl_update(struct sdl_context *ctx, struct input_queue *input);
+int sdl_render(struct sdl_context *ctx, const struct frame *frame);
 
 #endif
@@ -0,0 +1,49 @@
+#include "timing.h"
+
+void frame_clock_init(struct frame_clock *clock, Uint32 hz)
+{
+    clock->freq = SDL_GetPerformanceFrequency();
+    clock->hz = hz;
+    clock->last = SDL_GetPerformanceCounter();
+    clock->accumulator = 0;
+    clock->dropped = 0;
+}
+
+Uint32 frame_clock_advance(struct frame_clock *clock)
+{
+    /* Number of whole steps due since the last call */
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 steps;
+
+    clock->accumulator += (now - clock->last) * clock->hz;
+    clock->last = now;
+
+    steps = clock->accumulator / clock->freq;
+    clock->accumulator -= steps * clock->freq;
+
+    if (steps > FRAME_CLOCK_MAX_STEPS) {
+        clock->dropped += steps - FRAME_CLOCK_MAX_STEPS;
+        steps = FRAME_CLOCK_MAX_STEPS;
+    }
+
+    return (Uint32)steps;
+}
+
+void frame_clock_sleep(const struct frame_clock *clock)
+{
+    /* Sleep until the next step is due. SDL_Delay only has millisecond
+     * resolution, so round up: waking late costs nothing but jitter, as
+     * the accumulator keeps the time slept. */
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 owed = clock->accumulator + (now - clock->last) * clock->hz;
+    Uint64 ms;
+
+    if (owed >= clock->freq) {
+        return;
+    }
+
+    ms = ((clock->freq - owed) * 1000 + clock->freq * clock->hz - 1)
+         / (clock->freq * clock->hz);
+
+    SDL_Delay((Uint32)ms);
+}
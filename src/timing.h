@@ -0,0 +1,31 @@
+#ifndef CHIP8_TIMING_H
+#define CHIP8_TIMING_H
+
+#include <SDL2/SDL.h>
+
+/* Fixed-step clock on SDL's performance counter. Elapsed time is
+ * accumulated as ticks * hz against the counter frequency, so steps come
+ * at exactly hz per second on average with no rounding drift, however
+ * uneven the calls. */
+
+/* Steps owed beyond this after a stall (a debugger, a suspended laptop)
+ * are dropped rather than run in a burst */
+#define FRAME_CLOCK_MAX_STEPS 4
+
+struct frame_clock {
+    Uint64 freq;
+    Uint64 hz;
+    Uint64 last;
+
+    /* Elapsed ticks * hz not yet taken as steps; a step is freq of it */
+    Uint64 accumulator;
+
+    /* Steps dropped by FRAME_CLOCK_MAX_STEPS */
+    Uint64 dropped;
+};
+
+void frame_clock_init(struct frame_clock *clock, Uint32 hz);
+Uint32 frame_clock_advance(struct frame_clock *clock);
+void frame_clock_sleep(const struct frame_clock *clock);
+
+#endif
@@ -0,0 +1,95 @@
+#include "wav.h"
+#include "bytes.h"
+
+#include <string.h>
+
+#define WAV_HEADER_SIZE 44
+
+/* Samples converted per fwrite */
+#define WAV_CHUNK 1024
+
+static int wav_write_header(struct wav_writer *wav);
+
+int wav_open(struct wav_writer *wav, const char *path, uint32_t rate)
+{
+    memset(wav, 0, sizeof(*wav));
+    wav->rate = rate;
+
+    if (beeper_init(&wav->beeper, rate, BEEPER_TONE_HZ, BEEPER_AMPLITUDE)) {
+        return 1;
+    }
+
+    if ((wav->file = fopen(path, "wb")) == NULL) {
+        beeper_free(&wav->beeper);
+        return 1;
+    }
+
+    /* Sizes are filled in by wav_close */
+    if (wav_write_header(wav)) {
+        wav_close(wav);
+        return 1;
+    }
+
+    return 0;
+}
+
+void wav_write(struct wav_writer *wav, uint32_t samples, int on)
+{
+    int16_t pcm[WAV_CHUNK];
+    uint8_t bytes[WAV_CHUNK * 2];
+
+    wav->samples += samples;
+
+    while (samples > 0) {
+        uint32_t count = samples < WAV_CHUNK ? samples : WAV_CHUNK;
+
+        beeper_fill(&wav->beeper, pcm, count, on);
+
+        for (uint32_t s = 0; s < count; ++s) {
+            put_u16(bytes + s * 2, (uint16_t)pcm[s]);
+        }
+
+        fwrite(bytes, 2, count, wav->file);
+        samples -= count;
+    }
+}
+
+int wav_close(struct wav_writer *wav)
+{
+    /* Returns 1 if anything failed to write */
+    int failed = 0;
+
+    if (wav->file) {
+        failed = fseek(wav->file, 0, SEEK_SET) != 0 || wav_write_header(wav);
+        failed |= ferror(wav->file) != 0;
+        failed |= fclose(wav->file) != 0;
+        wav->file = NULL;
+    }
+
+    beeper_free(&wav->beeper);
+
+    return failed;
+}
+
+static int wav_write_header(struct wav_writer *wav)
+{
+    uint8_t header[WAV_HEADER_SIZE];
+    uint32_t data_size = (uint32_t)(wav->samples * 2);
+
+    memcpy(header, "RIFF", 4);
+    put_u32(header + 4, WAV_HEADER_SIZE - 8 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+
+    /* PCM, mono, 16 bits per sample */
+    put_u32(header + 16, 16);
+    put_u16(header + 20, 1);
+    put_u16(header + 22, 1);
+    put_u32(header + 24, wav->rate);
+    put_u32(header + 28, wav->rate * 2);
+    put_u16(header + 32, 2);
+    put_u16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    put_u32(header + 40, data_size);
+
+    return fwrite(header, 1, sizeof(header), wav->file) != sizeof(header);
+}
@@ -0,0 +1,22 @@
+#ifndef CHIP8_WAV_H
+#define CHIP8_WAV_H
+
+#include "beeper.h"
+
+#include <stdio.h>
+
+/* Beeper output to a 16-bit mono WAV file, the audio sink for frontends
+ * without a sound device */
+
+struct wav_writer {
+    FILE *file;
+    struct beeper beeper;
+    uint32_t rate;
+    uint64_t samples;
+};
+
+int wav_open(struct wav_writer *wav, const char *path, uint32_t rate);
+void wav_write(struct wav_writer *wav, uint32_t samples, int on);
+int wav_close(struct wav_writer *wav);
+
+#endif